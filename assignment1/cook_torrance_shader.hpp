@@ -1,15 +1,19 @@
 #pragma once
 
+#include "common/instanced_model.hpp"
+#include "common/mesh.hpp"
+#include "common/shader.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 #include "teapot.hpp"
 
 namespace cs7gv3::ass1 {
 
-extern teapot_t teapot[3];
+extern teapot_t teapot;
 
 constexpr uint8_t cook_torrance_vs[] = R"(
 #version 330 core
-
+)" CS7GV3_FRAME_BLOCK_GLSL CS7GV3_INSTANCE_GLSL R"(
 layout(location = 0) in vec3 pos_in;
 layout(location = 1) in vec3 normal_in;
 layout(location = 2) in vec2 texture_coordinate_in;
@@ -17,40 +21,33 @@ layout(location = 2) in vec2 texture_coordinate_in;
 out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
+flat out vec3 tint;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
+    vec4 pos = instance_transform * vec4(pos_in, 1.0);
     texture_coordinate = texture_coordinate_in;
-    frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
+    frag_pos = vec3(transform * pos);
+    normal = normal_matrix * instance_normal_matrix * normal_in;
+    tint = instance_color;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * pos;
 }
 )";
 
 constexpr uint8_t cook_torrance_fs[] = R"(
 #version 330 core
-
+)" CS7GV3_LOD_FADE_GLSL CS7GV3_FRAME_BLOCK_GLSL CS7GV3_LIGHT_BLOCK_GLSL
+    CS7GV3_MATERIAL_BLOCK_GLSL R"(
 in vec3 frag_pos;
 in vec3 normal;
+flat in vec3 tint;
 
 out vec4 frag_color;
 
-// material
-uniform vec3 albedo;
-uniform float metallic;
-uniform float roughness;
-uniform float ao;
-
-// lights
-uniform vec3 view_pos;
-
-uniform vec3 light_position;
-uniform vec3 light_color;
-
 const float PI = 3.14159265359;
 
 float distribution_GGX(vec3 N, vec3 H, float roughness) {
@@ -90,19 +87,22 @@ vec3 fresnel_schlick(float cosTheta, vec3 F0) {
 }
 
 void main() {
+  lod_dither();
+
   vec3 N = normalize(normal);
   vec3 V = normalize(view_pos - frag_pos);
-  vec3 L = normalize(light_position - frag_pos);
+  vec3 L = normalize(light.position - frag_pos);
   vec3 H = normalize(V + L);
 
   // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
   // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)    
+  vec3 albedo = material.albedo * tint;
   vec3 F0 = vec3(0.04);
-  F0 = mix(F0, albedo, metallic);
+  F0 = mix(F0, albedo, material.metallic);
 
   // Cook-Torrance BRDF
-  float NDF = distribution_GGX(N, H, roughness);
-  float G = geometry_smith(N, V, L, roughness);
+  float NDF = distribution_GGX(N, H, material.roughness);
+  float G = geometry_smith(N, V, L, material.roughness);
   vec3 F = fresnel_schlick(clamp(dot(H, V), 0.0, 1.0), F0);
 
   vec3 numerator = NDF * G * F;
@@ -118,7 +118,7 @@ void main() {
   // multiply kD by the inverse metalness such that only non-metals 
   // have diffuse lighting, or a linear blend if partly metal (pure metals
   // have no diffuse light).
-  kD *= 1.0 - metallic;
+  kD *= 1.0 - material.metallic;
 
   // scale light by NdotL
   float NdotL = max(dot(N, L), 0.0);        
@@ -126,9 +126,10 @@ void main() {
   // add to outgoing radiance Lo
   // note that we already multiplied the BRDF by the Fresnel (kS) 
   // so we won't multiply by kS again
-  vec3 Lo = (kD * albedo / PI + specular) * light_color * NdotL;
+  vec3 radiance = light.diffuse_color;
+  vec3 Lo = (kD * albedo / PI + specular) * radiance * NdotL;
 
-  vec3 ambient = vec3(0.03) * albedo * ao;
+  vec3 ambient = vec3(0.03) * albedo * material.ao;
 
   vec3 color = ambient + Lo;
   color = color / (color + vec3(1.0));
@@ -138,10 +139,10 @@ void main() {
 }
 )";
 
-class cook_torrance_shader_t final : public figine::core::shader_if {
+class cook_torrance_shader_t final : public common::shader_t {
 public:
   cook_torrance_shader_t()
-      : figine::core::shader_if(cook_torrance_vs, cook_torrance_fs) {}
+      : common::shader_t(cook_torrance_vs, cook_torrance_fs) {}
 };
 
 class cook_torrance_console_t final : public figine::imnotgui::window_t {
@@ -149,18 +150,36 @@ public:
   virtual void refresh() final {
     static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    shading_t &s = teapot.shading[teapot_t::cook_torrance];
     ImGui::Begin("cook_torrance light console");
-    ImGui::ColorEdit3("albedo", (float *)&teapot[2].albedo);
-    ImGui::SliderFloat("metallic", &teapot[2].metallic, 0.0f, 1.0f);
-    ImGui::SliderFloat("roughness", &teapot[2].roughness, 0.0f, 1.0f);
-    ImGui::SliderFloat("ao", &teapot[2].ao, 0.0f, 1.0f);
+    ImGui::ColorEdit3("albedo", (float *)&s.albedo);
+    ImGui::SliderFloat("metallic", &s.metallic, 0.0f, 1.0f);
+    ImGui::SliderFloat("roughness", &s.roughness, 0.0f, 1.0f);
+    ImGui::SliderFloat("ao", &s.ao, 0.0f, 1.0f);
+
+    ImGui::SliderFloat3("light_position", (float *)&s.light.position, -100.0f,
+                        100.0f);
+    ImGui::ColorEdit3("light_color", (float *)&s.light.diffuse_color);
 
-    ImGui::SliderFloat3("light_position", (float *)&teapot[2].light.position,
-                        -100.0f, 100.0f);
-    ImGui::ColorEdit3("light_color", (float *)&teapot[2].light.diffuse_color);
+    // an edit in any window counts, update() drops blocks that did not change
+    teapot.dirty |= ImGui::IsAnyItemActive();
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
 
     ImGui::End();
   }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common/deferred.hpp"
+#include "figine/figine.hpp"
+
+namespace cs7gv3::ass1 {
+
+extern common::deferred_renderer_t deferred;
+
+class deferred_console_t final : public figine::imnotgui::window_t {
+public:
+  bool enabled = false;
+
+  virtual void refresh() final {
+    static const char *const brdfs[] = {"phong", "gooch", "cook-torrance"};
+
+    ImGui::Begin("deferred console");
+    ImGui::Checkbox("deferred shading", &enabled);
+    int brdf = (int)deferred.brdf;
+    if (ImGui::Combo("brdf", &brdf, brdfs, 3)) {
+      deferred.brdf = (common::brdf_t)brdf;
+    }
+    ImGui::End();
+  }
+};
+
+} // namespace cs7gv3::ass1
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cook_torrance_shader.hpp"
+#include "deferred_console.hpp"
 #include "gooch_shader.hpp"
 #include "phong_shader.hpp"
 #include "teapot.hpp"
@@ -18,19 +19,21 @@ inline gooch_console_t gooch_console;
 inline cook_torrance_shader_t cook_torrance_shader;
 inline cook_torrance_console_t cook_torrance_console;
 
-inline teapot_t teapot[] = {
-    teapot_t({0, 0, 0}, &camera),
-    teapot_t({0, 0, 0}, &camera),
-    teapot_t({3, 0, 0}, &camera),
-};
+inline common::deferred_renderer_t deferred;
+inline deferred_console_t deferred_console;
 
+inline teapot_t teapot({0, 0, 0}, &camera);
+inline common::render_queue_t render_queue;
+inline common::occlusion_t occlusion;
+
+// only the shader drawn at startup is linked here, the others link on
+// their first bind()
 inline void init() {
-  phong_shader.build();
-  gooch_shader.build();
-  cook_torrance_shader.build();
-  for (int i = 0; i < 3; i++) {
-    teapot[i].init();
-  }
+  phong_shader.link();
+  deferred.init();
+  occlusion.init();
+  teapot.occlusion = &occlusion;
+  teapot.init();
 }
 
 } // namespace cs7gv3::ass1
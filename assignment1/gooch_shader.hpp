@@ -1,15 +1,19 @@
 #pragma once
 
+#include "common/instanced_model.hpp"
+#include "common/mesh.hpp"
+#include "common/shader.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 #include "teapot.hpp"
 
 namespace cs7gv3::ass1 {
 
-extern teapot_t teapot[3];
+extern teapot_t teapot;
 
 constexpr uint8_t gooch_vs[] = R"(
 #version 330 core
-
+)" CS7GV3_FRAME_BLOCK_GLSL CS7GV3_INSTANCE_GLSL R"(
 layout(location = 0) in vec3 pos_in;
 layout(location = 1) in vec3 normal_in;
 layout(location = 2) in vec2 texture_coordinate_in;
@@ -17,46 +21,33 @@ layout(location = 2) in vec2 texture_coordinate_in;
 out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
+flat out vec3 tint;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
+    vec4 pos = instance_transform * vec4(pos_in, 1.0);
     texture_coordinate = texture_coordinate_in;
-    frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
+    frag_pos = vec3(transform * pos);
+    normal = normal_matrix * instance_normal_matrix * normal_in;
+    tint = instance_color;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * pos;
 }
 )";
 
 constexpr uint8_t gooch_fs[] = R"(
 #version 330 core
-
-struct material_t {
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-  float shininess;
-};
-
-struct light_t {
-  vec3 position;
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-};
-
+)" CS7GV3_LOD_FADE_GLSL CS7GV3_FRAME_BLOCK_GLSL CS7GV3_LIGHT_BLOCK_GLSL
+    CS7GV3_MATERIAL_BLOCK_GLSL R"(
 in vec3 frag_pos;
 in vec3 normal;
+flat in vec3 tint;
 
 out vec4 frag_color;
 
-uniform vec3 view_pos;
-uniform material_t material;
-uniform light_t light;
-
 uniform float a;
 uniform float b;
 uniform vec3 k_blue;
@@ -71,6 +62,8 @@ vec3 k_warm_f(vec3 k_d) {
 }
 
 void main() {
+  lod_dither();
+
   vec3 norm = normalize(normal);
   vec3 view_direction = normalize(view_pos - frag_pos);
   vec3 light_direction = normalize(light.position - frag_pos);
@@ -82,7 +75,8 @@ void main() {
   // diffuse 
   float diff = dot(-light_direction, norm);
   float dot_1_2 = (1.0 + diff) / 2.0;
-  vec3 diffuse_color = diff * light.diffuse_color * material.diffuse_color;
+  vec3 k_d = material.diffuse_color * tint;
+  vec3 diffuse_color = diff * light.diffuse_color * k_d;
   vec3 k_cool = k_cool_f(diffuse_color);
   vec3 k_warm = k_warm_f(diffuse_color);
   vec3 diffuse = dot_1_2 * k_cool + (1.0 - dot_1_2) * k_warm;
@@ -95,9 +89,9 @@ void main() {
 }
 )";
 
-class gooch_shader_t final : public figine::core::shader_if {
+class gooch_shader_t final : public common::shader_t {
 public:
-  gooch_shader_t() : figine::core::shader_if(gooch_vs, gooch_fs) {}
+  gooch_shader_t() : common::shader_t(gooch_vs, gooch_fs) {}
 };
 
 class gooch_console_t final : public figine::imnotgui::window_t {
@@ -105,35 +99,46 @@ public:
   virtual void refresh() final {
     static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    shading_t &s = teapot.shading[teapot_t::gooch];
     ImGui::Begin("gooch light console");
     ImGui::Text("material: ");
-    ImGui::SliderFloat("m.shininess", &teapot[1].material.shininess, 0.0f,
-                       100.0f);
-    ImGui::ColorEdit3("m.ambient_color",
-                      (float *)&teapot[1].material.ambient_color);
-    ImGui::ColorEdit3("m.diffuse_color",
-                      (float *)&teapot[1].material.diffuse_color);
-    ImGui::ColorEdit3("m.specular_color",
-                      (float *)&teapot[1].material.specular_color);
+    ImGui::SliderFloat("m.shininess", &s.material.shininess, 0.0f, 100.0f);
+    ImGui::ColorEdit3("m.ambient_color", (float *)&s.material.ambient_color);
+    ImGui::ColorEdit3("m.diffuse_color", (float *)&s.material.diffuse_color);
+    ImGui::ColorEdit3("m.specular_color", (float *)&s.material.specular_color);
 
     ImGui::Text("light: ");
-    ImGui::SliderFloat3("l.position", (float *)&teapot[1].light.position,
-                        -100.0f, 100.0f);
-    ImGui::ColorEdit3("l.ambient_color",
-                      (float *)&teapot[1].light.ambient_color);
-    ImGui::ColorEdit3("l.diffuse_color",
-                      (float *)&teapot[1].light.diffuse_color);
-    ImGui::ColorEdit3("l.specular_color",
-                      (float *)&teapot[1].light.specular_color);
+    ImGui::SliderFloat3("l.position", (float *)&s.light.position, -100.0f,
+                        100.0f);
+    ImGui::ColorEdit3("l.ambient_color", (float *)&s.light.ambient_color);
+    ImGui::ColorEdit3("l.diffuse_color", (float *)&s.light.diffuse_color);
+    ImGui::ColorEdit3("l.specular_color", (float *)&s.light.specular_color);
 
     ImGui::Text("gooch: ");
-    ImGui::SliderFloat("alpha", &teapot[1].a, 0, 1);
-    ImGui::SliderFloat("beta", &teapot[1].b, 0, 1);
-    ImGui::ColorEdit3("k_blue", (float *)&teapot[1].k_blue);
-    ImGui::ColorEdit3("k_yellow", (float *)&teapot[1].k_yellow);
+    ImGui::SliderFloat("alpha", &s.a, 0, 1);
+    ImGui::SliderFloat("beta", &s.b, 0, 1);
+    ImGui::ColorEdit3("k_blue", (float *)&s.k_blue);
+    ImGui::ColorEdit3("k_yellow", (float *)&s.k_yellow);
+
+    // an edit in any window counts, update() drops blocks that did not change
+    teapot.dirty |= ImGui::IsAnyItemActive();
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
 
     ImGui::End();
   }
@@ -17,6 +17,7 @@ int main() {
   figine::imnotgui::register_window(&phong_console);
   figine::imnotgui::register_window(&gooch_console);
   figine::imnotgui::register_window(&cook_torrance_console);
+  figine::imnotgui::register_window(&deferred_console);
 
   camera.lock({0, 0, 0});
   float last_time = 0;
@@ -30,11 +31,34 @@ int main() {
 
     process_input(window, delta_time);
 
-    teapot[0].loop(phong_shader);
-    // teapot[1].loop(gooch_shader);
-    // teapot[2].loop(cook_torrance_shader);
-
+    cs7gv3::common::streamer::update();
+    cs7gv3::common::update_frame(camera, current_time);
+
+    render_queue.clear();
+    occlusion.begin_frame();
+    if (deferred_console.enabled) {
+      // the consoles edit the teapot, the lighting pass reads its own copy.
+      // the light is the drawn shading's, the tones the gooch console's.
+      const shading_t &gooch = teapot.shading[teapot_t::gooch];
+      deferred.light = teapot.shading[teapot.drawn].light;
+      deferred.gooch = {gooch.a, gooch.b, gooch.k_blue, gooch.k_yellow};
+      deferred.begin(true);
+      teapot.submit(render_queue, deferred.geometry_shader());
+      render_queue.execute();
+      deferred.end(camera);
+    } else {
+      teapot.submit(render_queue, phong_shader);
+      render_queue.execute();
+    }
+    occlusion.capture(teapot.projection_matrix() * camera.view_matrix());
+
+    cs7gv3::common::uniform_stats.end_frame();
+    cs7gv3::common::gl_state.stats.end_frame();
+    cs7gv3::common::cull_stats.end_frame();
+    cs7gv3::common::occlusion_stats.end_frame();
     figine::imnotgui::render();
+    // the overlay leaves the GL state unknown
+    cs7gv3::common::gl_state.invalidate();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -1,15 +1,19 @@
 #pragma once
 
+#include "common/instanced_model.hpp"
+#include "common/mesh.hpp"
+#include "common/shader.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 #include "teapot.hpp"
 
 namespace cs7gv3::ass1 {
 
-extern teapot_t teapot[3];
+extern teapot_t teapot;
 
 constexpr uint8_t phong_vs[] = R"(
 #version 330 core
-
+)" CS7GV3_FRAME_BLOCK_GLSL CS7GV3_INSTANCE_GLSL R"(
 layout(location = 0) in vec3 pos_in;
 layout(location = 1) in vec3 normal_in;
 layout(location = 2) in vec2 texture_coordinate_in;
@@ -17,47 +21,36 @@ layout(location = 2) in vec2 texture_coordinate_in;
 out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
+flat out vec3 tint;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
+    vec4 pos = instance_transform * vec4(pos_in, 1.0);
     texture_coordinate = texture_coordinate_in;
-    frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
+    frag_pos = vec3(transform * pos);
+    normal = normal_matrix * instance_normal_matrix * normal_in;
+    tint = instance_color;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * pos;
 }
 )";
 
 constexpr uint8_t phong_fs[] = R"(
 #version 330 core
-
-struct material_t {
-    float shininess;
-    vec3 ambient_color;
-    vec3 diffuse_color;
-    vec3 specular_color;
-};
-
-struct light_t {
-    vec3 position;
-    vec3 ambient_color;
-    vec3 diffuse_color;
-    vec3 specular_color;
-};
-
+)" CS7GV3_LOD_FADE_GLSL CS7GV3_FRAME_BLOCK_GLSL CS7GV3_LIGHT_BLOCK_GLSL
+    CS7GV3_MATERIAL_BLOCK_GLSL R"(
 in vec3 frag_pos;
 in vec3 normal;
+flat in vec3 tint;
 
 out vec4 frag_color;
 
-uniform vec3 view_pos;
-uniform material_t material;
-uniform light_t light;
-
 void main() {
+    lod_dither();
+
     vec3 norm = normalize(normal);
     vec3 view_direction = normalize(view_pos - frag_pos);
     vec3 light_direction = normalize(frag_pos - light.position);
@@ -68,7 +61,7 @@ void main() {
 
     // diffuse 
     float diff = max(dot(norm, -light_direction), 0.0);
-    vec3 diffuse = diff * light.diffuse_color * material.diffuse_color;
+    vec3 diffuse = diff * light.diffuse_color * material.diffuse_color * tint;
 
     // specular
     float spec = pow(max(dot(view_direction, reflect_direction), 0.0), material.shininess);
@@ -78,9 +71,9 @@ void main() {
 }
 )";
 
-class phong_shader_t final : public figine::core::shader_if {
+class phong_shader_t final : public common::shader_t {
 public:
-  phong_shader_t() : figine::core::shader_if(phong_vs, phong_fs) {}
+  phong_shader_t() : common::shader_t(phong_vs, phong_fs) {}
 };
 
 class phong_console_t final : public figine::imnotgui::window_t {
@@ -88,29 +81,50 @@ public:
   virtual void refresh() final {
     static ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    shading_t &s = teapot.shading[teapot_t::phong];
     ImGui::Begin("phong light console");
     ImGui::Text("material: ");
-    ImGui::SliderFloat("m.shininess", &teapot[0].material.shininess, 0.0f,
-                       100.0f);
-    ImGui::ColorEdit3("m.ambient_color",
-                      (float *)&teapot[0].material.ambient_color);
-    ImGui::ColorEdit3("m.diffuse_color",
-                      (float *)&teapot[0].material.diffuse_color);
-    ImGui::ColorEdit3("m.specular_color",
-                      (float *)&teapot[0].material.specular_color);
+    ImGui::SliderFloat("m.shininess", &s.material.shininess, 0.0f, 100.0f);
+    ImGui::ColorEdit3("m.ambient_color", (float *)&s.material.ambient_color);
+    ImGui::ColorEdit3("m.diffuse_color", (float *)&s.material.diffuse_color);
+    ImGui::ColorEdit3("m.specular_color", (float *)&s.material.specular_color);
 
     ImGui::Text("light: ");
-    ImGui::SliderFloat3("l.position", (float *)&teapot[0].light.position,
-                        -100.0f, 100.0f);
-    ImGui::ColorEdit3("l.ambient_color",
-                      (float *)&teapot[0].light.ambient_color);
-    ImGui::ColorEdit3("l.diffuse_color",
-                      (float *)&teapot[0].light.diffuse_color);
-    ImGui::ColorEdit3("l.specular_color",
-                      (float *)&teapot[0].light.specular_color);
+    ImGui::SliderFloat3("l.position", (float *)&s.light.position, -100.0f,
+                        100.0f);
+    ImGui::ColorEdit3("l.ambient_color", (float *)&s.light.ambient_color);
+    ImGui::ColorEdit3("l.diffuse_color", (float *)&s.light.diffuse_color);
+    ImGui::ColorEdit3("l.specular_color", (float *)&s.light.specular_color);
+
+    ImGui::Text("instances: ");
+    ImGui::SliderInt("count", &teapot.instance_count, 1, 4096);
+
+    // an edit in any window counts, update() drops blocks that did not change
+    teapot.dirty |= ImGui::IsAnyItemActive();
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
+    const common::occlusion_stats_t &occlusion = common::occlusion_stats;
+    ImGui::Text("occlusion: %zu tested, %zu occluded, %zu queried",
+                occlusion.last_tested, occlusion.last_occluded,
+                occlusion.last_conditional);
+    ImGui::Text("gpu: scene %.2f ms, hi-z %.2f ms, ~%.2f ms saved",
+                occlusion.scene_ms, occlusion.hiz_ms,
+                occlusion.saved_ms(common::cull_stats.last_visible));
 
     ImGui::End();
   }
@@ -1,16 +1,23 @@
 #pragma once
 
+#include "common/instanced_model.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 namespace cs7gv3::ass1 {
 
-class teapot_t : public figine::core::object_t {
-public:
-  teapot_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
-           bool gamma_correction = false)
-      : figine::core::object_t("model/teapot.obj", camera, gamma_correction),
-        _init_pos(init_pos) {}
+namespace teapot_uniforms {
+constexpr common::uniform_t a = "a";
+constexpr common::uniform_t b = "b";
+constexpr common::uniform_t k_blue = "k_blue";
+constexpr common::uniform_t k_yellow = "k_yellow";
+} // namespace teapot_uniforms
 
+// what one console edits, the material and light of each shading model
+struct shading_t {
   // phong
   figine::builtin::shader::material_t material = {
       .shininess = 16.0f,
@@ -34,49 +41,96 @@ public:
 
   // cook-torrance
   glm::vec3 albedo = glm::vec3(1.0f);
-  GLfloat metallic;
-  GLfloat roughness;
-  GLfloat ao;
+  GLfloat metallic = 0.0f;
+  GLfloat roughness = 0.0f;
+  GLfloat ao = 0.0f;
+};
+
+// every teapot on screen is an instance of this one object, they share the
+// mesh and the shading the consoles picked
+class teapot_t : public common::instanced_model_t {
+public:
+  // the shading edited by each console
+  static constexpr size_t phong = 0;
+  static constexpr size_t gooch = 1;
+  static constexpr size_t cook_torrance = 2;
+
+  teapot_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
+           bool gamma_correction = false)
+      : common::instanced_model_t("model/teapot.obj", camera,
+                                  gamma_correction),
+        _init_pos(init_pos) {}
+
+  shading_t shading[3];
+  // the one drawn with
+  size_t drawn = phong;
+
+  // set by the consoles when a widget moved, the light and material blocks
+  // are only rebuilt then
+  bool dirty = true;
+
+  // teapots laid out on a square grid around the first one
+  int instance_count = 1;
+  float instance_spacing = 3.0f;
 
   void init() override {
-    object_t::init();
+    lod_cross_fade = true;
+    model_t::init();
+    _light_slot = common::light_blocks.allocate();
+    _material_slot = common::material_blocks.allocate();
     transform = translate(_init_pos);
   }
 
   void update() override {
-    object_t::update();
+    model_t::update();
     transform = rotate_around(glm::radians(1.0f), {0, 1, 0});
+    if ((size_t)instance_count != instances.size()) {
+      layout_instances();
+    }
   }
 
   void apply_uniform(const figine::core::shader_if &shader) override {
-    object_t::apply_uniform(shader);
-
-    shader.set_uniform("light.position", light.position);
-    shader.set_uniform("light.ambient_color", light.ambient_color);
-    shader.set_uniform("light.diffuse_color", light.diffuse_color);
-    shader.set_uniform("light.specular_color", light.specular_color);
-
-    shader.set_uniform("material.shininess", material.shininess);
-    shader.set_uniform("material.ambient_color", material.ambient_color);
-    shader.set_uniform("material.diffuse_color", material.diffuse_color);
-    shader.set_uniform("material.specular_color", material.specular_color);
-
-    shader.set_uniform("a", a);
-    shader.set_uniform("b", b);
-    shader.set_uniform("k_blue", k_blue);
-    shader.set_uniform("k_yellow", k_yellow);
-
-    shader.set_uniform("albedo", albedo);
-    shader.set_uniform("metallic", metallic);
-    shader.set_uniform("roughness", roughness);
-    shader.set_uniform("ao", ao);
-
-    shader.set_uniform("light_position", light.position);
-    shader.set_uniform("light_color", light.diffuse_color);
+    model_t::apply_uniform(shader);
+    namespace u = teapot_uniforms;
+    const common::uniform_table_t &uniforms = common::current_uniforms();
+
+    const shading_t &s = shading[drawn];
+    if (dirty) {
+      common::material_block_t block = common::material_block(s.material);
+      block.albedo = s.albedo;
+      block.metallic = s.metallic;
+      block.roughness = s.roughness;
+      block.ao = s.ao;
+      common::material_blocks.update(_material_slot, block);
+      common::light_blocks.update(_light_slot, common::light_block(s.light));
+      dirty = false;
+    }
+    common::material_blocks.bind(_material_slot);
+    common::light_blocks.bind(_light_slot);
+
+    uniforms.set(u::a, s.a);
+    uniforms.set(u::b, s.b);
+    uniforms.set(u::k_blue, s.k_blue);
+    uniforms.set(u::k_yellow, s.k_yellow);
   }
 
 private:
   glm::vec3 _init_pos;
+
+  void layout_instances() {
+    size_t n = std::max(instance_count, 1);
+    int side = std::ceil(std::sqrt((float)n));
+    instances.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      glm::vec3 offset(i % side, 0.0f, i / side);
+      instances[i].transform =
+          glm::translate(glm::mat4(1.0f), offset * instance_spacing);
+    }
+    instances_dirty = true;
+  }
+
+  size_t _light_slot = 0;
+  size_t _material_slot = 0;
 };
 
 } // namespace cs7gv3::ass1
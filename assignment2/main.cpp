@@ -28,10 +28,20 @@ int main() {
 
     process_input(window, delta_time);
 
-    sphere.loop();
-    skybox.loop();
+    cs7gv3::common::streamer::update();
+    cs7gv3::common::update_frame(camera, current_time);
 
+    render_queue.clear();
+    sphere.submit(render_queue);
+    skybox.submit(render_queue);
+    render_queue.execute();
+
+    cs7gv3::common::uniform_stats.end_frame();
+    cs7gv3::common::gl_state.stats.end_frame();
+    cs7gv3::common::cull_stats.end_frame();
     figine::imnotgui::render();
+    // the overlay leaves the GL state unknown
+    cs7gv3::common::gl_state.invalidate();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -1,16 +1,19 @@
 #pragma once
 
-#include "figine/builtin/object/skybox.hpp"
+#include "common/model.hpp"
+#include "common/shader.hpp"
+#include "common/skybox.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 
 namespace cs7gv3::ass1 {
 
-extern figine::builtin::object::skybox_t skybox;
+extern common::skybox_t skybox;
 extern figine::core::camera_t camera;
 
 constexpr uint8_t sphere_vs[] = R"(
 #version 330 core
-
+)" CS7GV3_FRAME_BLOCK_GLSL R"(
 layout(location = 0) in vec3 pos_in;
 layout(location = 1) in vec3 normal_in;
 
@@ -18,95 +21,94 @@ out vec3 frag_pos;
 out vec3 normal;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
     frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    normal = normal_matrix * normal_in;
+    gl_Position = mvp * vec4(pos_in, 1.0);
 }
 )";
 
 constexpr uint8_t sphere_fs[] = R"(
 #version 330 core
+)" CS7GV3_FRAME_BLOCK_GLSL R"(
 out vec4 frag_color;
 
 in vec3 normal;
 in vec3 frag_pos;
 
-uniform vec3 camera_pos;
 uniform samplerCube skybox;
 
-uniform bool use_reflect;
-uniform bool use_refract;
-uniform bool use_chromatic;
-
 uniform float fresnel_pow;
 uniform float refract_ratio;
 uniform vec3 refract_ratio3;
 
 vec3 cal_reflect() {
-  vec3 I = normalize(frag_pos - camera_pos);
+  vec3 I = normalize(frag_pos - view_pos);
   vec3 R = reflect(I, normalize(normal));
 
   return R;
 }
 
 vec3 cal_refract() {
-  vec3 I = normalize(frag_pos - camera_pos);
-  vec3 R = vec3(0.0, 0.0, 0.0);
-  if (use_chromatic) {
-    R = vec3(
-      refract(I, normalize(normal), refract_ratio3.r).r,
-      refract(I, normalize(normal), refract_ratio3.g).g,
-      refract(I, normalize(normal), refract_ratio3.b).b
-    );
-  } else {
-    R = refract(I, normalize(normal), refract_ratio);
-  }
+  vec3 I = normalize(frag_pos - view_pos);
+#ifdef USE_CHROMATIC
+  vec3 R = vec3(
+    refract(I, normalize(normal), refract_ratio3.r).r,
+    refract(I, normalize(normal), refract_ratio3.g).g,
+    refract(I, normalize(normal), refract_ratio3.b).b
+  );
+#else
+  vec3 R = refract(I, normalize(normal), refract_ratio);
+#endif
 
   return R;
 }
 
 void main() {
-    vec4 reflect_res = vec4(0.0, 0.0, 0.0, 0.0);
-    vec4 refract_res = vec4(0.0, 0.0, 0.0, 0.0);
-
-    float fresnel = 0.0;
-    if (use_chromatic) {
-      fresnel = ((1.0 - refract_ratio3.g) * (1.0 - refract_ratio3.g)) / ((1.0 + refract_ratio3.g) * (1.0 + refract_ratio3.g));
-    } else {
-      fresnel = ((1.0 - refract_ratio) * (1.0 - refract_ratio)) / ((1.0 + refract_ratio) * (1.0 + refract_ratio));
-    }
-    float ratio = fresnel + (1.0 - fresnel) * pow((1.0 - dot(-frag_pos, normal)), fresnel_pow);
-  
-    if (use_reflect) {
-      reflect_res = vec4(texture(skybox, cal_reflect()).rgb, 1.0);
-    }
+    vec3 color = vec3(0.0, 0.0, 0.0);
 
-    if (use_refract) {
-      refract_res = vec4(texture(skybox, cal_refract()).rgb, 1.0);
-    }
+#if defined(USE_REFLECT) && defined(USE_REFRACT)
+#ifdef USE_CHROMATIC
+    float fresnel = ((1.0 - refract_ratio3.g) * (1.0 - refract_ratio3.g)) / ((1.0 + refract_ratio3.g) * (1.0 + refract_ratio3.g));
+#else
+    float fresnel = ((1.0 - refract_ratio) * (1.0 - refract_ratio)) / ((1.0 + refract_ratio) * (1.0 + refract_ratio));
+#endif
+    float ratio = fresnel + (1.0 - fresnel) * pow((1.0 - dot(-frag_pos, normal)), fresnel_pow);
 
-    vec3 color = vec3(0.0, 0.0, 0.0);
-    if (use_refract && use_reflect) {
-      color = mix(refract_res.rgb, reflect_res.rgb, ratio);
-    } else if (use_refract) {
-      color = refract_res.rgb;
-    } else {
-      color = reflect_res.rgb;
-    }
+    vec3 reflect_res = texture(skybox, cal_reflect()).rgb;
+    vec3 refract_res = texture(skybox, cal_refract()).rgb;
+    color = mix(refract_res, reflect_res, ratio);
+#elif defined(USE_REFRACT)
+    color = texture(skybox, cal_refract()).rgb;
+#elif defined(USE_REFLECT)
+    color = texture(skybox, cal_reflect()).rgb;
+#endif
 
     frag_color = vec4(color, 1.0);
 }
 )";
 
-class sphere_t : public figine::core::object_t {
+namespace sphere_uniforms {
+constexpr common::uniform_t fresnel_pow = "fresnel_pow";
+constexpr common::uniform_t refract_ratio = "refract_ratio";
+constexpr common::uniform_t refract_ratio3 = "refract_ratio3";
+} // namespace sphere_uniforms
+
+// variant bits of the sphere shader, in the order of sphere_shader_t
+namespace sphere_features {
+constexpr uint32_t reflect = 1u << 0;
+constexpr uint32_t refract = 1u << 1;
+constexpr uint32_t chromatic = 1u << 2;
+} // namespace sphere_features
+
+class sphere_t : public common::model_t {
 public:
   sphere_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
            bool gamma_correction = false)
-      : figine::core::object_t("model/sphere.off", camera, gamma_correction),
+      : common::model_t("model/sphere.off", camera, gamma_correction),
         _init_pos(init_pos) {}
 
   float fresnel_pow = 1.0f;
@@ -116,73 +118,53 @@ public:
   bool use_refract = true;
   bool use_chromatic = true;
 
+  uint32_t features() const {
+    namespace f = sphere_features;
+    return (use_reflect ? f::reflect : 0) | (use_refract ? f::refract : 0) |
+           (use_chromatic ? f::chromatic : 0);
+  }
+
   void init() override {
-    object_t::init();
-    _shader.build();
+    model_t::init();
+    _shader.build(features());
     transform = translate(_init_pos);
     transform = scale(glm::vec3(0.1f));
 
-    for (const auto &mesh : object_t::_meshes) {
-      glBindVertexArray(mesh.vao);
-      defer(glBindVertexArray(0));
-      glGenTextures(1, &_box_texture);
-      glBindTexture(GL_TEXTURE_CUBE_MAP, _box_texture);
-
-      for (size_t i = 0; i < skybox.faces.size(); i++) {
-        int width = 0, height = 0, nr_components = 0;
-        uint8_t *data = stbi_load(skybox.faces[i].c_str(), &width, &height,
-                                  &nr_components, 0);
-        defer(stbi_image_free(data));
-        if (data) {
-          glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width,
-                       height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        } else {
-          LOG_ERR("cubemap texture failed to load at path: %s",
-                  skybox.faces[i].c_str());
-        }
-      }
-
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    }
+    // same registry entry as the skybox, decoded and uploaded once
+    _box_texture = common::texture_registry::load_cubemap(skybox.faces);
   }
 
-  void update() override { object_t::update(); }
+  void update() override { model_t::update(); }
 
   void apply_uniform(const figine::core::shader_if &shader) override {
-    object_t::apply_uniform(shader);
-    shader.set_uniform("use_reflect", use_reflect);
-    shader.set_uniform("use_refract", use_refract);
-    shader.set_uniform("use_chromatic", use_chromatic);
-    shader.set_uniform("fresnel_pow", fresnel_pow);
-    shader.set_uniform("refract_ratio", refract_ratio);
-    shader.set_uniform("refract_ratio3", refract_ratio3);
-    shader.set_uniform("camera_pos", camera->position);
+    model_t::apply_uniform(shader);
+    namespace u = sphere_uniforms;
+    const common::uniform_table_t &uniforms = common::current_uniforms();
+    uniforms.set(u::fresnel_pow, fresnel_pow);
+    uniforms.set(u::refract_ratio, refract_ratio);
+    uniforms.set(u::refract_ratio3, refract_ratio3);
+    // here rather than in draw_mesh(), which batched meshes skip
+    common::gl_state.bind_texture(0, GL_TEXTURE_CUBE_MAP,
+                                  _box_texture->bind_id());
   }
 
-  void loop() {
-    update();
-    apply_uniform(_shader);
-
-    for (const auto &mesh : object_t::_meshes) {
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_CUBE_MAP, _box_texture);
-      mesh.draw(_shader);
-    }
+  // a console switch only changes which variant draws
+  void submit(common::render_queue_t &queue) {
+    model_t::submit(queue, _shader.variant(features()));
   }
 
 private:
-  class sphere_shader_t final : public figine::core::shader_if {
+  class sphere_shader_t final : public common::shader_variants_t {
   public:
-    sphere_shader_t() : figine::core::shader_if(sphere_vs, sphere_fs) {}
+    sphere_shader_t()
+        : common::shader_variants_t(
+              sphere_vs, sphere_fs,
+              {"USE_REFLECT", "USE_REFRACT", "USE_CHROMATIC"}) {}
   };
 
   glm::vec3 _init_pos;
   sphere_shader_t _shader;
-  GLuint _box_texture;
+  common::texture_ref_t _box_texture;
 };
 
 extern sphere_t sphere;
@@ -210,6 +192,20 @@ public:
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
 
     ImGui::End();
   }
@@ -28,9 +28,19 @@ int main(int argc, char **argv) {
 
     process_input(window, delta_time);
 
-    shield.loop(phong_shader);
+    cs7gv3::common::streamer::update();
+    cs7gv3::common::update_frame(camera, current_time);
 
+    render_queue.clear();
+    shield.submit(render_queue, phong_shader.variant(shield.features()));
+    render_queue.execute();
+
+    cs7gv3::common::uniform_stats.end_frame();
+    cs7gv3::common::gl_state.stats.end_frame();
+    cs7gv3::common::cull_stats.end_frame();
     figine::imnotgui::render();
+    // the overlay leaves the GL state unknown
+    cs7gv3::common::gl_state.invalidate();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "common/packed_vertex.hpp"
+#include "common/shader.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 #include "shield.hpp"
 
@@ -9,27 +12,14 @@ extern shield_t shield;
 
 constexpr uint8_t phong_vs[] = R"(
 #version 330 core
-
+)" CS7GV3_PACKED_VERTEX_GLSL CS7GV3_FRAME_BLOCK_GLSL CS7GV3_LIGHT_BLOCK_GLSL
+    CS7GV3_MATERIAL_BLOCK_GLSL R"(
 layout(location = 0) in vec3 pos_in;
 layout(location = 1) in vec3 normal_in;
 layout(location = 2) in vec2 texture_coordinate_in;
-layout(location = 3) in vec3 tangent_in;
+layout(location = 3) in vec4 tangent_in;
 layout(location = 4) in vec3 bitangent_in;
 
-struct material_t {
-  float shininess;
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-};
-
-struct light_t {
-  vec3 position;
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-};
-
 struct vs_out_t {
   vec3 frag_pos;
   vec3 normal;
@@ -41,50 +31,35 @@ struct vs_out_t {
 
 out vs_out_t vs_out;
 
-uniform material_t material;
-uniform light_t light;
-
-uniform mat4 view;
-uniform vec3 view_pos;
 uniform mat4 transform;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
-  vs_out.frag_pos = vec3(transform * vec4(pos_in, 1.0));
+  vec3 pos = decode_position(pos_in);
+  vec3 bitangent = decode_bitangent(normal_in, tangent_in, bitangent_in);
+
+  vs_out.frag_pos = vec3(transform * vec4(pos, 1.0));
   vs_out.texture_coordinate = texture_coordinate_in;
 
-  mat3 normal = transpose(inverse(mat3(transform)));
-  vec3 T = normalize(vec3(transform * vec4(tangent_in,   0.0)));
-  vec3 B = normalize(vec3(transform * vec4(bitangent_in, 0.0)));
-  vec3 N = normalize(vec3(transform * vec4(normal_in,    0.0)));
+  vec3 T = normalize(vec3(transform * vec4(tangent_in.xyz, 0.0)));
+  vec3 B = normalize(vec3(transform * vec4(bitangent,      0.0)));
+  vec3 N = normalize(vec3(transform * vec4(normal_in,      0.0)));
   mat3 TBN = transpose(mat3(T, B, N));
 
-  vs_out.normal = normal * normal_in;
+  vs_out.normal = normal_matrix * normal_in;
   vs_out.tangent_light_pos = TBN * light.position;
   vs_out.tangent_view_pos  = TBN * view_pos;
   vs_out.tangent_frag_pos  = TBN * vs_out.frag_pos;
 
-  gl_Position = projection * view * transform * vec4(pos_in, 1.0);
+  gl_Position = mvp * vec4(pos, 1.0);
 }
 )";
 
 constexpr uint8_t phong_fs[] = R"(
 #version 330 core
-
-struct material_t {
-  float shininess;
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-};
-
-struct light_t {
-  vec3 position;
-  vec3 ambient_color;
-  vec3 diffuse_color;
-  vec3 specular_color;
-};
-
+)" CS7GV3_FRAME_BLOCK_GLSL CS7GV3_LIGHT_BLOCK_GLSL
+    CS7GV3_MATERIAL_BLOCK_GLSL R"(
 struct vs_out_t {
   vec3 frag_pos;
   vec3 normal;
@@ -98,12 +73,6 @@ in vs_out_t vs_out;
 
 out vec4 frag_color;
 
-uniform bool use_norm;
-
-uniform vec3 view_pos;
-uniform material_t material;
-uniform light_t light;
-
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_normal1;
 
@@ -156,17 +125,19 @@ vec4 cal_regular() {
 }
 
 void main() {
-  if (use_norm) {
-    frag_color = cal_with_norm();
-  } else {
-    frag_color = cal_regular();
-  }
+#ifdef USE_NORM
+  frag_color = cal_with_norm();
+#else
+  frag_color = cal_regular();
+#endif
 }
 )";
 
-class phong_shader_t final : public figine::core::shader_if {
+// features in the order of shield_features
+class phong_shader_t final : public common::shader_variants_t {
 public:
-  phong_shader_t() : figine::core::shader_if(phong_vs, phong_fs) {}
+  phong_shader_t()
+      : common::shader_variants_t(phong_vs, phong_fs, {"USE_NORM"}) {}
 };
 
 class phong_console_t final : public figine::imnotgui::window_t {
@@ -195,8 +166,25 @@ public:
     ImGui::ColorEdit3("l.specular_color",
                       (float *)&shield.light.specular_color);
 
+    // an edit in any window counts, update() drops blocks that did not change
+    shield.dirty |= ImGui::IsAnyItemActive();
+
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
 
     ImGui::End();
   }
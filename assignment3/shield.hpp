@@ -1,18 +1,31 @@
 #pragma once
 
+#include "common/model.hpp"
+#include "common/uniform_block.hpp"
 #include "figine/figine.hpp"
 
 namespace cs7gv3::ass3 {
 
-class shield_t : public figine::core::object_t {
+// variant bits of phong_shader_t
+namespace shield_features {
+constexpr uint32_t norm = 1u << 0;
+} // namespace shield_features
+
+class shield_t : public common::model_t {
 public:
   shield_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
            bool gamma_correction = false)
-      : figine::core::object_t("model/shield.obj", camera, gamma_correction),
+      : common::model_t("model/shield.obj", camera, gamma_correction),
         _init_pos(init_pos) {}
 
   bool use_norm = true;
 
+  uint32_t features() const { return use_norm ? shield_features::norm : 0; }
+
+  // set by the console when a widget moved, the light and material blocks
+  // are only rebuilt then
+  bool dirty = true;
+
   // phong
   figine::builtin::shader::material_t material = {
       .shininess = 16.0f,
@@ -29,36 +42,35 @@ public:
   };
 
   void init() override {
-    object_t::init();
+    packed_vertices = true;
+    model_t::init();
+    _light_slot = common::light_blocks.allocate();
+    _material_slot = common::material_blocks.allocate();
     transform = translate(_init_pos);
     transform = scale(glm::vec3(2.0f));
     transform =
         rotate_around(glm::radians(180.0f), glm::vec3{0.0f, 1.0f, 0.0f});
   }
 
-  void update() override { object_t::update(); }
+  void update() override { model_t::update(); }
 
   void apply_uniform(const figine::core::shader_if &shader) override {
-    object_t::apply_uniform(shader);
-
-    shader.set_uniform("light.position", light.position);
-    shader.set_uniform("light.ambient_color", light.ambient_color);
-    shader.set_uniform("light.diffuse_color", light.diffuse_color);
-    shader.set_uniform("light.specular_color", light.specular_color);
-
-    shader.set_uniform("material.shininess", material.shininess);
-    shader.set_uniform("material.ambient_color", material.ambient_color);
-    shader.set_uniform("material.diffuse_color", material.diffuse_color);
-    shader.set_uniform("material.specular_color", material.specular_color);
-
-    shader.set_uniform("light_position", light.position);
-    shader.set_uniform("light_color", light.diffuse_color);
+    model_t::apply_uniform(shader);
 
-    shader.set_uniform("use_norm", use_norm);
+    if (dirty) {
+      common::light_blocks.update(_light_slot, common::light_block(light));
+      common::material_blocks.update(_material_slot,
+                                     common::material_block(material));
+      dirty = false;
+    }
+    common::light_blocks.bind(_light_slot);
+    common::material_blocks.bind(_material_slot);
   }
 
 private:
   glm::vec3 _init_pos;
+  size_t _light_slot = 0;
+  size_t _material_slot = 0;
 };
 
 } // namespace cs7gv3::ass3
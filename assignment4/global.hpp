@@ -11,9 +11,10 @@ inline phong_shader_t phong_shader;
 inline phong_console_t phong_console;
 
 inline shield_t shield = shield_t({0, 0, 0}, &camera);
+inline common::render_queue_t render_queue;
 
 inline void init() {
-  phong_shader.build();
+  phong_shader.build(shield.features());
   shield.init();
 }
 
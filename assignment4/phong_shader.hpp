@@ -1,5 +1,6 @@
 #pragma once
 
+#include "common/shader.hpp"
 #include "figine/figine.hpp"
 #include "shield.hpp"
 
@@ -19,15 +20,15 @@ out vec3 normal;
 out vec2 texture_coordinate;
 
 uniform mat4 transform;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
     texture_coordinate = texture_coordinate_in;
     frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
+    normal = normal_matrix * normal_in;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * vec4(pos_in, 1.0);
 }
 )";
 
@@ -41,24 +42,25 @@ in vec2 texture_coordinate;
 
 out vec4 frag_color;
 
-uniform bool use_mip;
 uniform float mipmap_level;
 
 uniform vec3 view_pos;
 uniform sampler2D texture_diffuse1;
 
 void main() {
-  if (use_mip) {
-    frag_color = vec4(texture(texture_diffuse1, texture_coordinate).rgb, 1.0);
-  } else {
-    frag_color = textureLod(texture_diffuse1, texture_coordinate, mipmap_level);
-  }
+#ifdef USE_MIP
+  frag_color = vec4(texture(texture_diffuse1, texture_coordinate).rgb, 1.0);
+#else
+  frag_color = textureLod(texture_diffuse1, texture_coordinate, mipmap_level);
+#endif
 }
 )";
 
-class phong_shader_t final : public figine::core::shader_if {
+// features in the order of shield_features
+class phong_shader_t final : public common::shader_variants_t {
 public:
-  phong_shader_t() : figine::core::shader_if(phong_vs, phong_fs) {}
+  phong_shader_t()
+      : common::shader_variants_t(phong_vs, phong_fs, {"USE_MIP"}) {}
 };
 
 class phong_console_t final : public figine::imnotgui::window_t {
@@ -75,6 +77,20 @@ public:
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
 
     ImGui::End();
   }
@@ -1,34 +1,47 @@
 #pragma once
 
+#include "common/model.hpp"
 #include "figine/figine.hpp"
 
 namespace cs7gv3::ass4 {
 
-class shield_t : public figine::core::object_t {
+namespace shield_uniforms {
+constexpr common::uniform_t mipmap_level = "mipmap_level";
+} // namespace shield_uniforms
+
+// variant bits of phong_shader_t
+namespace shield_features {
+constexpr uint32_t mip = 1u << 0;
+} // namespace shield_features
+
+class shield_t : public common::model_t {
 public:
   shield_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
            bool gamma_correction = false)
-      : figine::core::object_t("model/shield.obj", camera, gamma_correction),
+      : common::model_t("model/shield.obj", camera, gamma_correction),
         _init_pos(init_pos) {}
 
   bool use_mip = true;
   float mipmap_level = 3;
 
+  uint32_t features() const { return use_mip ? shield_features::mip : 0; }
+
   void init() override {
-    object_t::init();
+    model_t::init();
     transform = translate(_init_pos);
     transform = scale(glm::vec3(2.0f));
     transform =
         rotate_around(glm::radians(180.0f), glm::vec3{0.0f, 1.0f, 0.0f});
   }
 
-  void update() override { object_t::update(); }
+  void update() override { model_t::update(); }
 
   void apply_uniform(const figine::core::shader_if &shader) override {
-    object_t::apply_uniform(shader);
+    model_t::apply_uniform(shader);
+    namespace u = shield_uniforms;
+    const common::uniform_table_t &uniforms = common::current_uniforms();
 
-    shader.set_uniform("use_mip", use_mip);
-    shader.set_uniform("mipmap_level", mipmap_level);
+    uniforms.set(u::mipmap_level, mipmap_level);
   }
 
 private:
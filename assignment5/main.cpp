@@ -1,8 +1,13 @@
 #include "figine/figine.hpp"
 
+#include "common/light_cluster.hpp"
+#include "common/light_list.hpp"
+#include "common/projection.hpp"
+#include "common/shader.hpp"
+#include "stroke.hpp"
 #include "teapot.hpp"
 
-#include <limits>
+#include <cstring>
 #include <sstream>
 
 #include <glm/ext/matrix_projection.hpp>
@@ -12,20 +17,12 @@ constexpr uint8_t paint_vs[] = R"(
 #version 330 core
 
 layout(location = 0) in vec3 position_in;
-layout(location = 1) in vec3 normal_in;
-
-out vec3 frag_pos;
-out vec3 normal;
+layout(location = 1) in vec3 center_in;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
 
 void main() {
-    frag_pos = vec3(model * vec4(position_in, 1.0));
-    normal = mat3(transpose(inverse(model))) * normal_in;
-
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * vec4(position_in + center_in, 1.0);
 }
 )";
 
@@ -49,25 +46,26 @@ layout(location = 2) in vec2 texture_coordinate_in;
 out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
+out float view_depth;
 
 uniform mat4 transform;
 uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
     texture_coordinate = texture_coordinate_in;
     frag_pos = vec3(transform * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(transform))) * normal_in;
+    normal = normal_matrix * normal_in;
+    view_depth = -(view * vec4(frag_pos, 1.0)).z;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * vec4(pos_in, 1.0);
 }
 )";
 
 constexpr uint8_t phong_fs[] = R"(
 #version 330 core
-
-#define MAX_LIGHTS 128
-
+)" CS7GV3_LIGHT_LIST_GLSL CS7GV3_LIGHT_CLUSTER_GLSL R"(
 struct material_t {
     float shininess;
     vec3 ambient_color;
@@ -75,40 +73,36 @@ struct material_t {
     vec3 specular_color;
 };
 
-struct light_t {
-    vec3 position;
-    vec3 ambient_color;
-    vec3 diffuse_color;
-    vec3 specular_color;
-};
-
 in vec3 frag_pos;
 in vec3 normal;
+in float view_depth;
 
 out vec4 frag_color;
 
-uniform int n;
 uniform vec3 view_pos;
 uniform material_t material;
-uniform light_t light[MAX_LIGHTS];
+uniform float light_radius;
 
 void main() {
     vec3 ambient = vec3(0.3f, 0.3f, 0.3f);
     vec3 diffuse = vec3(0.0f, 0.0f, 0.0f);
     vec3 specular = vec3(0.0f, 0.0f, 0.0f);
 
-    for (int i = 0; i < n; i++) {
+    uvec2 range = cluster_range(gl_FragCoord.xy, view_depth);
+    for (uint k = 0u; k < range.y; k++) {
+      light_t light = fetch_light(cluster_light(range.x + k));
       vec3 norm = normalize(normal);
       vec3 view_direction = normalize(view_pos - frag_pos);
-      vec3 light_direction = normalize(frag_pos - light[i].position);
-      float light_length = length(frag_pos - light[i].position);
+      vec3 light_direction = normalize(frag_pos - light.position);
+      float light_length = length(frag_pos - light.position);
+      float attenuation = max(1 - light_length / light_radius, 0.0);
       vec3 reflect_direction = reflect(light_direction, norm);
 
       float diff = max(dot(norm, -light_direction), 0.0);
-      diffuse += (1 - light_length / 100) * diff * light[i].diffuse_color * material.diffuse_color;
+      diffuse += attenuation * diff * light.diffuse_color * material.diffuse_color;
 
       float spec = pow(max(dot(view_direction, reflect_direction), 0.0), material.shininess);
-      specular += (1 - light_length / 100) * spec * light[i].specular_color * material.specular_color;
+      specular += attenuation * spec * light.specular_color * material.specular_color;
     }
 
     frag_color = vec4(ambient + diffuse + specular, 1.0);
@@ -128,18 +122,70 @@ const uint32_t &win_width = figine::global::win_mgr::width;
 
 figine::core::camera_t camera({0.0f, 0.1f, 0.3f});
 
-figine::core::shader_if paint_shader(paint_vs, paint_fs);
-figine::core::shader_if teapot_shader(phong_vs, phong_fs);
+cs7gv3::common::shader_t paint_shader(paint_vs, paint_fs);
+cs7gv3::common::shader_t teapot_shader(phong_vs, phong_fs);
+
+namespace paint_uniforms {
+constexpr common::uniform_t mvp = "mvp";
+} // namespace paint_uniforms
+
+namespace lights_uniforms {
+constexpr common::uniform_t light_length = "light_length";
+constexpr common::uniform_t light_radius = "light_radius";
+} // namespace lights_uniforms
 
 teapot_t teapot({0, 0, 0}, &camera);
+common::render_queue_t render_queue;
 
 const glm::vec3 circle_scale{0.005f, 0.005f, 0.005f};
 
 std::vector<glm::vec3> selected_vertexes;
-std::vector<glm::vec3> circle_centers;
+stroke_t stroke;
 
 std::vector<glm::vec3> light_pos;
 
+// light_pos as the shader sees it, rebuilt only when light_pos or the
+// teapot's light colours change
+common::light_list_t lights;
+std::vector<common::light_block_t> uploaded_lights;
+
+// distance at which a light's contribution reaches zero, lights are binned
+// into clusters by it. set from the console, the teapot is well under a
+// unit across.
+float light_radius = 1.0f;
+common::light_clusters_t clusters;
+std::vector<glm::vec4> light_spheres;
+
+void sync_lights() {
+  common::light_block_t colors = common::light_block(teapot.light);
+  bool dirty = uploaded_lights.size() != light_pos.size();
+  for (size_t i = 0; !dirty && i < light_pos.size(); i++) {
+    colors.position = light_pos[i];
+    dirty = std::memcmp(&colors, &uploaded_lights[i], sizeof(colors)) != 0;
+  }
+  if (!dirty) {
+    return;
+  }
+
+  uploaded_lights.resize(light_pos.size());
+  for (size_t i = 0; i < light_pos.size(); i++) {
+    colors.position = light_pos[i];
+    uploaded_lights[i] = colors;
+  }
+  lights.assign(uploaded_lights.data(), uploaded_lights.size());
+}
+
+void build_clusters() {
+  light_spheres.resize(light_pos.size());
+  for (size_t i = 0; i < light_pos.size(); i++) {
+    light_spheres[i] = glm::vec4(light_pos[i], light_radius);
+  }
+  clusters.grid.near = common::near_plane;
+  clusters.grid.far = common::far_plane;
+  clusters.build(light_spheres, camera.view_matrix(),
+                 common::projection_matrix(camera));
+}
+
 class phong_console_t final : public figine::imnotgui::window_t {
 public:
   bool preview_enable = false;
@@ -173,6 +219,23 @@ public:
     }
 
     ImGui::Checkbox("enable preview", &preview_enable);
+    ImGui::SliderFloat("light radius", &light_radius, 0.05f, 10.0f);
+
+    ImGui::Text("uniforms: %zu set, %zu skipped",
+                common::uniform_stats.last_issued,
+                common::uniform_stats.last_skipped);
+    ImGui::Text("programs: %zu cached in %.1f ms, %zu compiled in %.1f ms",
+                common::program_stats.loaded,
+                common::program_stats.loaded_ms,
+                common::program_stats.compiled,
+                common::program_stats.compiled_ms);
+    ImGui::Text("gl state: %zu set, %zu skipped",
+                common::gl_state.stats.last_issued,
+                common::gl_state.stats.last_skipped);
+    ImGui::Text("culling: %zu visible, %zu culled",
+                common::cull_stats.last_visible,
+                common::cull_stats.last_culled);
+    ImGui::Text("clusters: %zu light references", clusters.references());
 
     ImGui::End();
   }
@@ -187,9 +250,10 @@ phong_console_t console;
 void init() {
   using namespace cs7gv3::ass5;
 
-  paint_shader.build();
-  teapot_shader.build();
+  paint_shader.link();
+  teapot_shader.link();
 
+  teapot.point_queries = true;
   teapot.init();
   teapot.scale(glm::vec3(0.01f));
 }
@@ -197,6 +261,11 @@ void init() {
 void mouse_event_cbk(GLFWwindow *window, double x_pos_in, double y_pos_in) {
   using namespace cs7gv3::ass5;
 
+  // nothing to pick until the model has streamed in
+  if (!teapot.resident()) {
+    return;
+  }
+
   static int last_status = GLFW_RELEASE;
   // int current_status = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
   int current_status = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT);
@@ -211,9 +280,7 @@ void mouse_event_cbk(GLFWwindow *window, double x_pos_in, double y_pos_in) {
     z = 0.5f;
   }
 
-  auto proj =
-      glm::perspective(glm::radians(camera.zoom),
-                       figine::global::win_mgr::aspect_ratio(), 0.1f, 100.0f);
+  auto proj = cs7gv3::common::projection_matrix(camera);
   glm::mat4 teapot_model = teapot.transform;
   glm::mat4 circle_model = glm::scale(glm::mat4(1.0f), circle_scale);
   glm::vec3 gl_world_pos =
@@ -224,24 +291,19 @@ void mouse_event_cbk(GLFWwindow *window, double x_pos_in, double y_pos_in) {
       glm::unProject(glm::vec3{x, y, 0}, camera.view_matrix() * circle_model,
                      proj, glm::vec4{0.0f, 0.0f, win_width, win_height});
 
-  size_t idx = 0;
-  float min = std::numeric_limits<float>::max();
-  for (size_t i = 0; i < teapot._meshes[0]._vertices.size(); i += 3) {
-    glm::vec3 P_i = teapot._meshes[0]._vertices[i].position;
-    glm::vec3 X = gl_world_pos;
-    float tmp = glm::abs(glm::distance(P_i, X));
-    if (tmp < min) {
-      min = tmp;
-      idx = i;
-    }
+  // unProject() through the teapot's transform lands in its model space
+  cs7gv3::common::model_t::vertex_hit_t hit;
+  if (!teapot.nearest_vertex(gl_world_pos, hit)) {
+    return;
   }
+  const cs7gv3::common::vertex_t &vertex =
+      teapot._meshes[hit.mesh]._vertices[hit.vertex];
 
   glm::vec3 frag_pos =
-      glm::vec3(teapot.transform *
-                glm::vec4(teapot._meshes[0]._vertices[idx].position, 1.0));
+      glm::vec3(teapot.transform * glm::vec4(vertex.position, 1.0));
   glm::vec3 R = camera.position - frag_pos; // R approximately equals to V
   glm::vec3 N = glm::mat3(glm::transpose(glm::inverse(teapot.transform))) *
-                teapot._meshes[0]._vertices[idx].normal;
+                vertex.normal;
   glm::vec3 I = -glm::reflect(R, N);
   glm::vec3 L = I + frag_pos;
   if (console.preview_enable) {
@@ -263,11 +325,11 @@ void mouse_event_cbk(GLFWwindow *window, double x_pos_in, double y_pos_in) {
 
   if (current_status == GLFW_PRESS && last_status == GLFW_RELEASE) {
     // key down
-    circle_centers.push_back(gl_show_pos);
+    stroke.push_back(gl_show_pos);
     selected_vertexes.push_back(gl_world_pos);
   } else if (current_status == GLFW_PRESS && last_status == GLFW_PRESS) {
     // holding
-    circle_centers.push_back(gl_show_pos);
+    stroke.push_back(gl_show_pos);
 
     selected_vertexes.push_back(gl_world_pos);
   } else if (current_status == GLFW_RELEASE && last_status == GLFW_PRESS) {
@@ -277,31 +339,25 @@ void mouse_event_cbk(GLFWwindow *window, double x_pos_in, double y_pos_in) {
         center += item;
       }
       center /= selected_vertexes.size();
-      size_t idx = 0;
-      float min = std::numeric_limits<float>::max();
-      for (size_t i = 0; i < teapot._meshes[0]._vertices.size(); i += 3) {
-        glm::vec3 P_i = teapot._meshes[0]._vertices[i].position;
-        glm::vec3 X = center;
-        float tmp = glm::abs(glm::distance(P_i, X));
-        if (tmp < min) {
-          min = tmp;
-          idx = i;
-        }
+      cs7gv3::common::model_t::vertex_hit_t hit;
+      if (teapot.nearest_vertex(center, hit)) {
+        const cs7gv3::common::vertex_t &vertex =
+            teapot._meshes[hit.mesh]._vertices[hit.vertex];
+
+        glm::vec3 frag_pos =
+            glm::vec3(teapot.transform * glm::vec4(vertex.position, 1.0));
+        glm::vec3 R = camera.position - frag_pos; // R approximately equals to V
+        glm::vec3 N =
+            glm::mat3(glm::transpose(glm::inverse(teapot.transform))) *
+            vertex.normal;
+        glm::vec3 I = -glm::reflect(R, N);
+        glm::vec3 L = I + frag_pos;
+
+        light_pos.push_back(L);
       }
 
-      glm::vec3 frag_pos =
-          glm::vec3(teapot.transform *
-                    glm::vec4(teapot._meshes[0]._vertices[idx].position, 1.0));
-      glm::vec3 R = camera.position - frag_pos; // R approximately equals to V
-      glm::vec3 N = glm::mat3(glm::transpose(glm::inverse(teapot.transform))) *
-                    teapot._meshes[0]._vertices[idx].normal;
-      glm::vec3 I = -glm::reflect(R, N);
-      glm::vec3 L = I + frag_pos;
-
-      light_pos.push_back(L);
-
       selected_vertexes.clear();
-      circle_centers.clear();
+      stroke.clear();
     }
 
   } else if (current_status == GLFW_RELEASE && last_status == GLFW_RELEASE) {
@@ -383,68 +439,22 @@ void process_input(GLFWwindow *window, float delta_time) {
   }
 }
 
-void render_circle(const glm::vec3 &pos) {
+void render_circles() {
   using namespace cs7gv3::ass5;
-
-  static uint32_t vao = 0, vbo = 0;
-  static float data[360 * 3 * 3] = {-0.5f, -0.5f, 0.0f, 0.5f, -0.5f,
-                                    0.0f,  0.0f,  0.5f, 0.0f};
-  static bool initialized = false;
-  if (!initialized) {
-    for (int i = 0, j = 0; i < 360; i++) {
-      // vertex 0
-      data[j++] = glm::cos(glm::radians((float)i));
-      data[j++] = glm::sin(glm::radians((float)i));
-      data[j++] = 0.0f;
-
-      // vertex 1
-      data[j++] = glm::cos(glm::radians((float)i + 1));
-      data[j++] = glm::sin(glm::radians((float)i + 1));
-      data[j++] = 0.0f;
-
-      // vertex 2
-      data[j++] = 0.0;
-      data[j++] = 0.0;
-      data[j++] = 0.0f;
-    }
-    initialized = true;
+  if (stroke.empty()) {
+    return;
   }
 
-  if (vao == 0) {
-    glGenVertexArrays(1, &vao);
-  }
+  namespace u = paint_uniforms;
+  paint_shader.bind();
+  const cs7gv3::common::uniform_table_t &uniforms =
+      cs7gv3::common::current_uniforms();
+  // the centers are in the circles' scaled space, see mouse_event_cbk()
+  glm::mat4 model = glm::scale(glm::mat4(1.0f), circle_scale);
+  glm::mat4 projection = cs7gv3::common::projection_matrix(camera);
+  uniforms.set(u::mvp, projection * camera.view_matrix() * model);
 
-  if (vbo == 0) {
-    glGenBuffers(1, &vbo);
-  }
-
-  glBindVertexArray(vao);
-
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), NULL);
-
-  paint_shader.use();
-  paint_shader.set_uniform("view_pos", camera.position);
-  paint_shader.set_uniform(
-      "projection",
-      glm::perspective(glm::radians(camera.zoom),
-                       figine::global::win_mgr::aspect_ratio(), 0.1f, 100.0f));
-  glm::mat4 model(1.0f);
-  model = glm::scale(model, circle_scale);
-  model = glm::translate(model, pos);
-  paint_shader.set_uniform("model", model);
-  paint_shader.set_uniform("view", camera.view_matrix());
-
-  glDrawArrays(GL_TRIANGLES, 0, 360 * 3);
-}
-
-void render_circles() {
-  using namespace cs7gv3::ass5;
-  for (const auto &pos : circle_centers) {
-    render_circle(pos);
-  }
+  stroke.draw();
 }
 
 int main(int argc, char **argv) {
@@ -462,9 +472,9 @@ int main(int argc, char **argv) {
 
   camera.lock({0, 0.1, 0});
   while (!glfwWindowShouldClose(window)) {
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LESS);
+    cs7gv3::common::gl_state.enable(GL_DEPTH_TEST, true);
+    cs7gv3::common::gl_state.depth_mask(true);
+    cs7gv3::common::gl_state.depth_func(GL_LESS);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     current = glfwGetTime();
@@ -473,26 +483,30 @@ int main(int argc, char **argv) {
 
     process_input(window, delta);
 
-    render_circles();
+    cs7gv3::common::streamer::update();
 
-    teapot_shader.use();
-    teapot_shader.set_uniform("n", light_pos.size());
-    teapot_shader.set_uniform("light_length", console.light_length);
-    for (size_t i = 0; i < light_pos.size(); i++) {
-      std::stringstream ss;
-      ss << "light[" << i << "].";
-      std::string prefix = ss.str();
-      teapot_shader.set_uniform(prefix + "position", light_pos[i]);
-      teapot_shader.set_uniform(prefix + "ambient_color",
-                                teapot.light.ambient_color);
-      teapot_shader.set_uniform(prefix + "diffuse_color",
-                                teapot.light.diffuse_color);
-      teapot_shader.set_uniform(prefix + "specular_color",
-                                teapot.light.specular_color);
-    }
-    teapot.loop(teapot_shader);
+    render_circles();
 
+    namespace u = lights_uniforms;
+    teapot_shader.bind();
+    const cs7gv3::common::uniform_table_t &uniforms =
+        cs7gv3::common::current_uniforms();
+    sync_lights();
+    build_clusters();
+    lights.bind();
+    clusters.bind();
+    uniforms.set(u::light_length, console.light_length);
+    uniforms.set(u::light_radius, light_radius);
+    render_queue.clear();
+    teapot.submit(render_queue, teapot_shader);
+    render_queue.execute();
+
+    cs7gv3::common::uniform_stats.end_frame();
+    cs7gv3::common::gl_state.stats.end_frame();
+    cs7gv3::common::cull_stats.end_frame();
     figine::imnotgui::render();
+    // the overlay leaves the GL state unknown
+    cs7gv3::common::gl_state.invalidate();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "common/gl_state.hpp"
+#include "figine/figine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// The circles painted along a stroke. A disc is uploaded once and every
+// circle is an instance of it, offset by its center. Centers are appended to
+// the instance buffer as the stroke grows, and the whole stroke is one draw.
+namespace cs7gv3::ass5 {
+
+class stroke_t {
+public:
+  // triangles of the disc, fanned around its center
+  static constexpr uint32_t segments = 360;
+
+  ~stroke_t() {
+    if (_vao && glfwGetCurrentContext()) {
+      common::gl_state.delete_vertex_arrays(1, &_vao);
+      common::gl_state.delete_buffers(3, _buffers);
+    }
+  }
+
+  void push_back(const glm::vec3 &center) { _centers.push_back(center); }
+
+  void clear() {
+    _centers.clear();
+    _uploaded = 0;
+  }
+
+  bool empty() const { return _centers.empty(); }
+
+  // uploads what was added since the last draw, the program and its mvp
+  // must be set. the vertex shader reads the disc at location 0 and the
+  // center at location 1.
+  void draw() {
+    if (_centers.empty()) {
+      return;
+    }
+    if (_vao == 0) {
+      create();
+    }
+    sync();
+
+    common::gl_state.bind_vertex_array(_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, segments * 3, GL_UNSIGNED_SHORT,
+                            nullptr, _centers.size());
+  }
+
+private:
+  GLuint _vao = 0;
+  // disc vertices, disc indices, centers
+  GLuint _buffers[3] = {};
+  size_t _capacity = 0;
+  // centers already in the buffer
+  size_t _uploaded = 0;
+  std::vector<glm::vec3> _centers;
+
+  void create() {
+    std::vector<glm::vec3> vertices = {glm::vec3(0.0f)};
+    std::vector<uint16_t> indices;
+    for (uint32_t i = 0; i < segments; i++) {
+      float angle = glm::radians(360.0f * i / segments);
+      vertices.push_back({std::cos(angle), std::sin(angle), 0.0f});
+      indices.push_back(1 + i);
+      indices.push_back(1 + (i + 1) % segments);
+      indices.push_back(0);
+    }
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(3, _buffers);
+    common::gl_state.bind_vertex_array(_vao);
+    defer(common::gl_state.bind_vertex_array(0));
+
+    common::gl_state.bind_array_buffer(_buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3),
+                 vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), NULL);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t),
+                 indices.data(), GL_STATIC_DRAW);
+
+    // the pointer survives glBufferData, growing keeps the attribute
+    common::gl_state.bind_array_buffer(_buffers[2]);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), NULL);
+    glVertexAttribDivisor(1, 1);
+  }
+
+  // appends the new centers, the buffer doubles when they do not fit and is
+  // then filled again from the start
+  void sync() {
+    if (_uploaded == _centers.size()) {
+      return;
+    }
+
+    common::gl_state.bind_array_buffer(_buffers[2]);
+    if (_centers.size() > _capacity) {
+      _capacity = std::max({_centers.size(), _capacity * 2, (size_t)256});
+      glBufferData(GL_ARRAY_BUFFER, _capacity * sizeof(glm::vec3), nullptr,
+                   GL_DYNAMIC_DRAW);
+      _uploaded = 0;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, _uploaded * sizeof(glm::vec3),
+                    (_centers.size() - _uploaded) * sizeof(glm::vec3),
+                    _centers.data() + _uploaded);
+    _uploaded = _centers.size();
+  }
+};
+
+} // namespace cs7gv3::ass5
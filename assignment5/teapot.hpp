@@ -1,15 +1,33 @@
 #pragma once
 
+#include "common/model.hpp"
 #include "figine/figine.hpp"
 #include "teapot.hpp"
 
 namespace cs7gv3::ass5 {
 
-class teapot_t : public figine::core::object_t {
+namespace teapot_uniforms {
+namespace light {
+constexpr common::uniform_t position = "light.position";
+constexpr common::uniform_t ambient_color = "light.ambient_color";
+constexpr common::uniform_t diffuse_color = "light.diffuse_color";
+constexpr common::uniform_t specular_color = "light.specular_color";
+} // namespace light
+namespace material {
+constexpr common::uniform_t shininess = "material.shininess";
+constexpr common::uniform_t ambient_color = "material.ambient_color";
+constexpr common::uniform_t diffuse_color = "material.diffuse_color";
+constexpr common::uniform_t specular_color = "material.specular_color";
+} // namespace material
+constexpr common::uniform_t light_position = "light_position";
+constexpr common::uniform_t light_color = "light_color";
+} // namespace teapot_uniforms
+
+class teapot_t : public common::model_t {
 public:
   teapot_t(const glm::vec3 &init_pos, figine::core::camera_t *camera,
            bool gamma_correction = false)
-      : figine::core::object_t("model/teapot.obj", camera, gamma_correction),
+      : common::model_t("model/teapot.obj", camera, gamma_correction),
         _init_pos(init_pos) {}
 
   // phong
@@ -28,31 +46,33 @@ public:
   };
 
   void init() override {
-    object_t::init();
+    model_t::init();
     transform = translate(_init_pos);
     transform = scale(glm::vec3{0.1f, 0.1f, 0.1f});
   }
 
   void update() override {
-    object_t::update();
+    model_t::update();
     // transform = rotate_around(glm::radians(1.0f), {0, 1, 0});
   }
 
   void apply_uniform(const figine::core::shader_if &shader) override {
-    object_t::apply_uniform(shader);
+    model_t::apply_uniform(shader);
+    namespace u = teapot_uniforms;
+    const common::uniform_table_t &uniforms = common::current_uniforms();
 
-    shader.set_uniform("light.position", light.position);
-    shader.set_uniform("light.ambient_color", light.ambient_color);
-    shader.set_uniform("light.diffuse_color", light.diffuse_color);
-    shader.set_uniform("light.specular_color", light.specular_color);
+    uniforms.set(u::light::position, light.position);
+    uniforms.set(u::light::ambient_color, light.ambient_color);
+    uniforms.set(u::light::diffuse_color, light.diffuse_color);
+    uniforms.set(u::light::specular_color, light.specular_color);
 
-    shader.set_uniform("material.shininess", material.shininess);
-    shader.set_uniform("material.ambient_color", material.ambient_color);
-    shader.set_uniform("material.diffuse_color", material.diffuse_color);
-    shader.set_uniform("material.specular_color", material.specular_color);
+    uniforms.set(u::material::shininess, material.shininess);
+    uniforms.set(u::material::ambient_color, material.ambient_color);
+    uniforms.set(u::material::diffuse_color, material.diffuse_color);
+    uniforms.set(u::material::specular_color, material.specular_color);
 
-    shader.set_uniform("light_position", light.position);
-    shader.set_uniform("light_color", light.diffuse_color);
+    uniforms.set(u::light_position, light.position);
+    uniforms.set(u::light_color, light.diffuse_color);
   }
 
 private:
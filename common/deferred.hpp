@@ -0,0 +1,452 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "instanced_model.hpp"
+#include "light_list.hpp"
+#include "mesh.hpp"
+#include "packed_vertex.hpp"
+#include "projection.hpp"
+#include "shader.hpp"
+#include "uniform.hpp"
+#include "uniform_block.hpp"
+
+// Deferred shading: a geometry pass writes surface attributes into a
+// G-buffer, a full-screen pass lights every pixel once with the chosen BRDF,
+// so lighting no longer pays for overdraw. Any object drawing meshes with
+// the material block bound works with it, pass geometry_shader() to its
+// loop() between begin() and end():
+//
+//   deferred.begin();
+//   teapot.loop(deferred.geometry_shader());
+//   deferred.end(camera);
+//
+// begin(true) selects the variant reading CS7GV3_INSTANCE_GLSL, for an
+// instanced_model_t.
+//
+// G-buffer layout:
+//   0  RGBA8    base colour (diffuse, or albedo for cook-torrance), ao
+//   1  RGBA16F  world normal, shininess
+//   2  RGBA8    specular colour, roughness
+//   3  RGBA8    ambient colour, metallic
+//      DEPTH24  depth, the world position is rebuilt from it
+namespace cs7gv3::common {
+
+enum class brdf_t : int { phong = 0, gooch = 1, cook_torrance = 2 };
+
+struct gooch_params_t {
+  float a = 0.2f;
+  float b = 0.6f;
+  glm::vec3 k_blue = {0.0f, 0.0f, 0.4f};
+  glm::vec3 k_yellow = {0.4f, 0.4f, 0.0f};
+};
+
+constexpr uint8_t gbuffer_vs[] = R"(
+#version 330 core
+)" CS7GV3_PACKED_VERTEX_GLSL CS7GV3_FRAME_BLOCK_GLSL R"(
+layout(location = 0) in vec3 pos_in;
+layout(location = 1) in vec3 normal_in;
+layout(location = 2) in vec2 texture_coordinate_in;
+layout(location = 3) in vec4 tangent_in;
+layout(location = 4) in vec3 bitangent_in;
+#ifdef INSTANCED
+)" CS7GV3_INSTANCE_GLSL R"(
+#endif
+
+out vec3 normal;
+out vec2 texture_coordinate;
+out mat3 tbn;
+flat out vec3 tint;
+
+uniform mat4 transform;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
+
+void main() {
+  vec4 pos = vec4(decode_position(pos_in), 1.0);
+  vec3 bitangent = decode_bitangent(normal_in, tangent_in, bitangent_in);
+
+  mat3 model = mat3(transform);
+  mat3 normal_model = normal_matrix;
+  tint = vec3(1.0);
+#ifdef INSTANCED
+  pos = instance_transform * pos;
+  model = model * mat3(instance_transform);
+  normal_model = normal_model * instance_normal_matrix;
+  tint = instance_color;
+#endif
+  normal = normal_model * normal_in;
+  tbn = mat3(normalize(model * tangent_in.xyz), normalize(model * bitangent),
+             normalize(normal));
+  texture_coordinate = texture_coordinate_in;
+
+  gl_Position = mvp * pos;
+}
+)";
+
+constexpr uint8_t gbuffer_fs[] = R"(
+#version 330 core
+)" CS7GV3_LOD_FADE_GLSL CS7GV3_MATERIAL_BLOCK_GLSL R"(
+in vec3 normal;
+in vec2 texture_coordinate;
+in mat3 tbn;
+flat in vec3 tint;
+
+layout(location = 0) out vec4 g_base;
+layout(location = 1) out vec4 g_normal;
+layout(location = 2) out vec4 g_specular;
+layout(location = 3) out vec4 g_ambient;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_normal1;
+uniform bool has_diffuse_map;
+uniform bool has_normal_map;
+// the normal map switch of objects that have one
+uniform bool use_norm = true;
+uniform int brdf;
+
+void main() {
+  lod_dither();
+
+  vec3 color = vec3(1.0);
+  if (has_diffuse_map) {
+    color = texture(texture_diffuse1, texture_coordinate).rgb;
+  }
+
+  vec3 n = normal;
+  if (has_normal_map && use_norm) {
+    vec3 t = texture(texture_normal1, texture_coordinate).rgb * 2.0 - 1.0;
+    n = tbn * t;
+  }
+
+  vec3 base = brdf == 2 ? material.albedo : material.diffuse_color;
+  g_base = vec4(color * base * tint, material.ao);
+  g_normal = vec4(normalize(n), material.shininess);
+  g_specular = vec4(material.specular_color, material.roughness);
+  g_ambient = vec4(color * material.ambient_color, material.metallic);
+}
+)";
+
+constexpr uint8_t lighting_vs[] = R"(
+#version 330 core
+
+out vec2 texture_coordinate;
+
+// one triangle covering the screen, no vertex buffer
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  texture_coordinate = p;
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+constexpr uint8_t lighting_fs[] = R"(
+#version 330 core
+)" CS7GV3_LIGHT_LIST_GLSL CS7GV3_FRAME_BLOCK_GLSL R"(
+in vec2 texture_coordinate;
+
+out vec4 frag_color;
+
+uniform sampler2D g_base;
+uniform sampler2D g_normal;
+uniform sampler2D g_specular;
+uniform sampler2D g_ambient;
+uniform sampler2D g_depth;
+
+uniform mat4 inverse_view_projection;
+uniform int brdf;
+uniform light_t light;
+uniform int light_count;
+
+uniform float a;
+uniform float b;
+uniform vec3 k_blue;
+uniform vec3 k_yellow;
+
+const float PI = 3.14159265359;
+
+struct surface_t {
+  vec3 pos;
+  vec3 normal;
+  vec3 base;
+  vec3 specular;
+  vec3 ambient;
+  float shininess;
+  float roughness;
+  float metallic;
+  float ao;
+};
+
+vec3 phong(surface_t s, light_t l, vec3 v) {
+  vec3 ld = normalize(s.pos - l.position);
+  float diff = max(dot(s.normal, -ld), 0.0);
+  float spec = pow(max(dot(v, reflect(ld, s.normal)), 0.0), s.shininess);
+  return diff * l.diffuse_color * s.base +
+         spec * l.specular_color * s.specular;
+}
+
+vec3 gooch(surface_t s, light_t l, vec3 v) {
+  vec3 ld = normalize(l.position - s.pos);
+  float diff = dot(-ld, s.normal);
+  float t = (1.0 + diff) / 2.0;
+  vec3 k_d = diff * l.diffuse_color * s.base;
+  vec3 diffuse = t * (k_blue + a * k_d) + (1.0 - t) * (k_yellow + b * k_d);
+  float spec = pow(max(dot(v, reflect(-ld, s.normal)), 0.0), s.shininess);
+  return diffuse + spec * l.specular_color * s.specular;
+}
+
+vec3 cook_torrance(surface_t s, light_t l, vec3 v) {
+  vec3 L = normalize(l.position - s.pos);
+  vec3 H = normalize(v + L);
+  vec3 N = s.normal;
+  float NdotL = max(dot(N, L), 0.0);
+  float NdotV = max(dot(N, v), 0.0);
+
+  float r2 = s.roughness * s.roughness;
+  float a2 = r2 * r2;
+  float NdotH = max(dot(N, H), 0.0);
+  float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+  float NDF = a2 / (PI * d * d);
+
+  float k = (s.roughness + 1.0) * (s.roughness + 1.0) / 8.0;
+  float G = NdotV / (NdotV * (1.0 - k) + k) * NdotL / (NdotL * (1.0 - k) + k);
+
+  vec3 F0 = mix(vec3(0.04), s.base, s.metallic);
+  vec3 F = F0 + (1.0 - F0) * pow(clamp(1.0 - dot(H, v), 0.0, 1.0), 5.0);
+
+  vec3 specular = NDF * G * F / (NdotV * NdotL + 0.0001);
+  vec3 kD = (vec3(1.0) - F) * (1.0 - s.metallic);
+  return (kD * s.base / PI + specular) * l.diffuse_color * NdotL;
+}
+
+vec3 shade(surface_t s, light_t l, vec3 v) {
+  if (brdf == 1) {
+    return gooch(s, l, v);
+  } else if (brdf == 2) {
+    return cook_torrance(s, l, v);
+  }
+  return phong(s, l, v);
+}
+
+void main() {
+  float depth = texture(g_depth, texture_coordinate).r;
+  if (depth == 1.0) {
+    discard;
+  }
+  gl_FragDepth = depth;
+
+  vec4 ndc = vec4(vec3(texture_coordinate, depth) * 2.0 - 1.0, 1.0);
+  vec4 world = inverse_view_projection * ndc;
+
+  vec4 base = texture(g_base, texture_coordinate);
+  vec4 normal = texture(g_normal, texture_coordinate);
+  vec4 specular = texture(g_specular, texture_coordinate);
+  vec4 ambient = texture(g_ambient, texture_coordinate);
+
+  surface_t s;
+  s.pos = world.xyz / world.w;
+  s.normal = normalize(normal.xyz);
+  s.base = base.rgb;
+  s.specular = specular.rgb;
+  s.ambient = ambient.rgb;
+  s.shininess = normal.w;
+  s.roughness = specular.a;
+  s.metallic = ambient.a;
+  s.ao = base.a;
+
+  vec3 v = normalize(view_pos - s.pos);
+  vec3 color = shade(s, light, v);
+  for (int i = 0; i < light_count; i++) {
+    color += shade(s, fetch_light(i), v);
+  }
+
+  if (brdf == 2) {
+    color += vec3(0.03) * s.base * s.ao;
+    color = color / (color + vec3(1.0));
+    color = pow(color, vec3(1.0 / 2.2));
+  } else {
+    color += light.ambient_color * s.ambient;
+  }
+  frag_color = vec4(color, 1.0);
+}
+)";
+
+namespace deferred_uniforms {
+constexpr uniform_t brdf = "brdf";
+constexpr uniform_t inverse_view_projection = "inverse_view_projection";
+constexpr uniform_t light_count = "light_count";
+constexpr uniform_t light_texels = "light_texels";
+constexpr uniform_t g_depth = "g_depth";
+constexpr uniform_t a = "a";
+constexpr uniform_t b = "b";
+constexpr uniform_t k_blue = "k_blue";
+constexpr uniform_t k_yellow = "k_yellow";
+namespace light {
+constexpr uniform_t position = "light.position";
+constexpr uniform_t ambient_color = "light.ambient_color";
+constexpr uniform_t diffuse_color = "light.diffuse_color";
+constexpr uniform_t specular_color = "light.specular_color";
+} // namespace light
+// the colour targets, in attachment order
+constexpr uniform_t targets[] = {"g_base", "g_normal", "g_specular",
+                                 "g_ambient"};
+} // namespace deferred_uniforms
+
+// GL thread only, init() after the context exists
+class deferred_renderer_t {
+public:
+  static constexpr int n_targets = 4;
+
+  brdf_t brdf = brdf_t::phong;
+  gooch_params_t gooch;
+  // lights every pixel, the light list adds any number on top
+  figine::builtin::shader::light_t light = {};
+  light_list_t *lights = nullptr;
+
+  deferred_renderer_t() = default;
+
+  ~deferred_renderer_t() {
+    // a global renderer outlives the window and its context
+    if (!glfwGetCurrentContext()) {
+      return;
+    }
+    release();
+    if (_vao) {
+      gl_state.delete_vertex_arrays(1, &_vao);
+    }
+  }
+
+  deferred_renderer_t(const deferred_renderer_t &) = delete;
+  deferred_renderer_t &operator=(const deferred_renderer_t &) = delete;
+
+  // the programs link on the first begin(), most runs never get there
+  void init() { glGenVertexArrays(1, &_vao); }
+
+  // the variant begin() selected
+  const shader_t &geometry_shader() {
+    return _geometry.variant(_instanced);
+  }
+
+  // redirects drawing into the G-buffer, sized to the current viewport
+  void begin(bool instanced = false) {
+    _instanced = instanced;
+    // before resize(), which leaves the default framebuffer bound
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_target);
+    GLint viewport[4] = {0, 0, 1, 1};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] != _width || viewport[3] != _height) {
+      resize(viewport[2], viewport[3]);
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    _geometry.variant(_instanced).bind();
+    current_uniforms().set(deferred_uniforms::brdf, (int)brdf);
+  }
+
+  // lights the G-buffer into the framebuffer bound at begin(), depth
+  // included so forward passes after it still sort against the scene
+  void end(const figine::core::camera_t &camera) {
+    namespace u = deferred_uniforms;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _target);
+
+    _lighting.bind();
+    const uniform_table_t &uniforms = current_uniforms();
+    for (int i = 0; i <= n_targets; i++) {
+      gl_state.bind_texture(i, GL_TEXTURE_2D, _textures[i]);
+      uniforms.set(i < n_targets ? u::targets[i] : u::g_depth, i);
+    }
+
+    uniforms.set(u::inverse_view_projection,
+                 glm::inverse(projection_matrix(camera) *
+                              camera.view_matrix()));
+    uniforms.set(u::brdf, (int)brdf);
+    uniforms.set(u::light::position, light.position);
+    uniforms.set(u::light::ambient_color, light.ambient_color);
+    uniforms.set(u::light::diffuse_color, light.diffuse_color);
+    uniforms.set(u::light::specular_color, light.specular_color);
+    uniforms.set(u::a, gooch.a);
+    uniforms.set(u::b, gooch.b);
+    uniforms.set(u::k_blue, gooch.k_blue);
+    uniforms.set(u::k_yellow, gooch.k_yellow);
+
+    // the light list sampler must stay off the G-buffer units
+    if (lights) {
+      lights->bind();
+    } else {
+      uniforms.set(u::light_texels, (int)light_list_t::texture_unit);
+    }
+    uniforms.set(u::light_count, lights ? (int)lights->size() : 0);
+
+    gl_state.depth_func(GL_ALWAYS);
+    defer(gl_state.depth_func(GL_LESS));
+    gl_state.bind_vertex_array(_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  }
+
+private:
+  shader_variants_t _geometry{gbuffer_vs, gbuffer_fs, {"INSTANCED"}};
+  bool _instanced = false;
+  shader_t _lighting{lighting_vs, lighting_fs};
+  GLuint _fbo = 0;
+  GLuint _vao = 0;
+  GLuint _textures[n_targets + 1] = {};
+  GLint _width = 0;
+  GLint _height = 0;
+  GLint _target = 0;
+
+  void resize(GLint width, GLint height) {
+    release();
+    _width = width;
+    _height = height;
+
+    const GLenum formats[n_targets + 1][3] = {
+        {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+        {GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT},
+        {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+        {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE},
+        {GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT},
+    };
+
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glGenTextures(n_targets + 1, _textures);
+    GLenum buffers[n_targets];
+    for (int i = 0; i <= n_targets; i++) {
+      gl_state.bind_texture(GL_TEXTURE_2D, _textures[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, formats[i][0], width, height, 0,
+                   formats[i][1], formats[i][2], nullptr);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      GLenum attachment =
+          i < n_targets ? GL_COLOR_ATTACHMENT0 + i : GL_DEPTH_ATTACHMENT;
+      glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                             _textures[i], 0);
+      if (i < n_targets) {
+        buffers[i] = attachment;
+      }
+    }
+    glDrawBuffers(n_targets, buffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      LOG_ERR("incomplete G-buffer, %dx%d", width, height);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // the G-buffer only, the vertex array lives as long as the renderer
+  void release() {
+    if (_fbo) {
+      glDeleteFramebuffers(1, &_fbo);
+      gl_state.delete_textures(n_targets + 1, _textures);
+      _fbo = 0;
+    }
+  }
+};
+
+} // namespace cs7gv3::common
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CS7GV3_FRUSTUM_SSE 1
+#define CS7GV3_FRUSTUM_SIMD 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CS7GV3_FRUSTUM_NEON 1
+#define CS7GV3_FRUSTUM_SIMD 1
+#endif
+
+// View frustum culling. The six planes come straight out of the
+// view-projection matrix and are stored a coordinate per array, so one SSE
+// or NEON step tests a bounding volume against four planes. Two extra
+// planes that nothing is ever behind pad the arrays to eight.
+namespace cs7gv3::common {
+
+// bounding volumes drawn and skipped, like uniform_stats_t
+struct cull_stats_t {
+  size_t visible = 0;
+  size_t culled = 0;
+  size_t last_visible = 0;
+  size_t last_culled = 0;
+
+  void end_frame() {
+    last_visible = visible;
+    last_culled = culled;
+    visible = culled = 0;
+  }
+};
+
+inline cull_stats_t cull_stats;
+
+class frustum_t {
+public:
+  // world space planes of a view-projection matrix, inside is positive
+  explicit frustum_t(const glm::mat4 &view_projection) {
+    const glm::mat4 &m = view_projection;
+    auto row = [&m](int i) {
+      return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+    const glm::vec4 planes[6] = {
+        row(3) + row(0), row(3) - row(0), row(3) + row(1),
+        row(3) - row(1), row(3) + row(2), row(3) - row(2),
+    };
+    for (int i = 0; i < 8; i++) {
+      glm::vec4 p = i < 6 ? planes[i] / glm::length(glm::vec3(planes[i]))
+                          : glm::vec4(0.0f, 0.0f, 0.0f, 1e30f);
+      _x[i] = p.x;
+      _y[i] = p.y;
+      _z[i] = p.z;
+      _w[i] = p.w;
+    }
+  }
+
+  bool sphere_visible(const glm::vec3 &center, float radius) const {
+#ifdef CS7GV3_FRUSTUM_SIMD
+    lanes_t cx = splat(center.x);
+    lanes_t cy = splat(center.y);
+    lanes_t cz = splat(center.z);
+    lanes_t r = splat(-radius);
+    for (int i = 0; i < 8; i += 4) {
+      if (any_less(distance(i, cx, cy, cz), r)) {
+        return false;
+      }
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++) {
+      if (_x[i] * center.x + _y[i] * center.y + _z[i] * center.z + _w[i] <
+          -radius) {
+        return false;
+      }
+    }
+    return true;
+#endif
+  }
+
+  // outside when even the corner furthest along a plane's normal is behind
+  // it
+  bool box_visible(const glm::vec3 &center, const glm::vec3 &extent) const {
+#ifdef CS7GV3_FRUSTUM_SIMD
+    lanes_t cx = splat(center.x);
+    lanes_t cy = splat(center.y);
+    lanes_t cz = splat(center.z);
+    lanes_t ex = splat(extent.x);
+    lanes_t ey = splat(extent.y);
+    lanes_t ez = splat(extent.z);
+    for (int i = 0; i < 8; i += 4) {
+      lanes_t reach = add(add(mul(abs(load(_x + i)), ex),
+                              mul(abs(load(_y + i)), ey)),
+                          mul(abs(load(_z + i)), ez));
+      if (any_less(add(distance(i, cx, cy, cz), reach), splat(0.0f))) {
+        return false;
+      }
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++) {
+      float d = _x[i] * center.x + _y[i] * center.y + _z[i] * center.z + _w[i];
+      float reach = std::abs(_x[i]) * extent.x + std::abs(_y[i]) * extent.y +
+                    std::abs(_z[i]) * extent.z;
+      if (d + reach < 0.0f) {
+        return false;
+      }
+    }
+    return true;
+#endif
+  }
+
+  // the sphere rejects most, the box what slips past the sphere's corners
+  bool visible(const bounds_t &bounds) const {
+    glm::vec3 center = bounds.center();
+    return sphere_visible(center, bounds.radius) &&
+           box_visible(center, bounds.extent());
+  }
+
+private:
+  alignas(16) float _x[8];
+  alignas(16) float _y[8];
+  alignas(16) float _z[8];
+  alignas(16) float _w[8];
+
+  // four lanes of the planes, the same steps on either instruction set
+#if defined(CS7GV3_FRUSTUM_SSE)
+  using lanes_t = __m128;
+  static lanes_t load(const float *p) { return _mm_load_ps(p); }
+  static lanes_t splat(float v) { return _mm_set1_ps(v); }
+  static lanes_t add(lanes_t a, lanes_t b) { return _mm_add_ps(a, b); }
+  static lanes_t mul(lanes_t a, lanes_t b) { return _mm_mul_ps(a, b); }
+  static lanes_t abs(lanes_t a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+  }
+  static bool any_less(lanes_t a, lanes_t b) {
+    return _mm_movemask_ps(_mm_cmplt_ps(a, b)) != 0;
+  }
+#elif defined(CS7GV3_FRUSTUM_NEON)
+  using lanes_t = float32x4_t;
+  static lanes_t load(const float *p) { return vld1q_f32(p); }
+  static lanes_t splat(float v) { return vdupq_n_f32(v); }
+  static lanes_t add(lanes_t a, lanes_t b) { return vaddq_f32(a, b); }
+  static lanes_t mul(lanes_t a, lanes_t b) { return vmulq_f32(a, b); }
+  static lanes_t abs(lanes_t a) { return vabsq_f32(a); }
+  // pairwise, vmaxvq_u32() is AArch64 only
+  static bool any_less(lanes_t a, lanes_t b) {
+    uint32x4_t less = vcltq_f32(a, b);
+    uint32x2_t m = vpmax_u32(vget_low_u32(less), vget_high_u32(less));
+    return vget_lane_u32(vpmax_u32(m, m), 0) != 0;
+  }
+#endif
+
+#ifdef CS7GV3_FRUSTUM_SIMD
+  // signed distance of a point to planes i .. i + 3
+  lanes_t distance(int i, lanes_t x, lanes_t y, lanes_t z) const {
+    return add(add(mul(load(_x + i), x), mul(load(_y + i), y)),
+               add(mul(load(_z + i), z), load(_w + i)));
+  }
+#endif
+};
+
+// visible[i] = test(i) for every i below n, in chunks spread over the pool
+// once there are enough to pay for it. returns how many passed.
+template <typename F>
+size_t cull_parallel(size_t n, std::vector<uint8_t> &visible, F test) {
+  constexpr size_t chunk = 1024;
+  visible.resize(n);
+  parallel_for((n + chunk - 1) / chunk, [&](size_t c) {
+    size_t end = std::min(n, (c + 1) * chunk);
+    for (size_t i = c * chunk; i < end; i++) {
+      visible[i] = test(i);
+    }
+  });
+  return std::count(visible.begin(), visible.end(), 1);
+}
+
+} // namespace cs7gv3::common
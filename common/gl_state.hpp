@@ -0,0 +1,217 @@
+#pragma once
+
+#include "figine/figine.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// Shadow of the binding and fixed function state the draw paths touch. A
+// call only reaches the driver when it changes what the shadow says is
+// bound. Code outside the tree (figine, the ImGui backend) changes state
+// behind its back, so the main loops call invalidate() once per frame after
+// the overlay and the first bind of each kind goes through again.
+//
+// GL thread only. Objects that may be bound are deleted through here too,
+// GL unbinds a deleted name and so must the shadow.
+namespace cs7gv3::common {
+
+// driver calls made and dropped as redundant, like uniform_stats_t
+struct gl_state_stats_t {
+  size_t issued = 0;
+  size_t skipped = 0;
+  size_t last_issued = 0;
+  size_t last_skipped = 0;
+
+  void end_frame() {
+    last_issued = issued;
+    last_skipped = skipped;
+    issued = skipped = 0;
+  }
+};
+
+class gl_state_t {
+public:
+  // the units the tree binds to, the light list sits on the last one
+  static constexpr GLuint max_units = 16;
+
+  gl_state_stats_t stats;
+
+  gl_state_t() { invalidate(); }
+
+  void use_program(GLuint program) {
+    if (changed(_program, program)) {
+      glUseProgram(program);
+    }
+  }
+
+  // the program in use, asks the driver only when the shadow is unknown
+  GLuint program() {
+    if (_program == unknown) {
+      GLint program = 0;
+      glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+      _program = program;
+    }
+    return _program;
+  }
+
+  void bind_vertex_array(GLuint vao) {
+    if (changed(_vao, vao)) {
+      glBindVertexArray(vao);
+    }
+  }
+
+  // GL_ELEMENT_ARRAY_BUFFER is vertex array state and is not shadowed
+  void bind_array_buffer(GLuint buffer) {
+    if (changed(_array_buffer, buffer)) {
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    }
+  }
+
+  void active_texture(GLuint unit) {
+    if (changed(_active_unit, unit)) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+    }
+  }
+
+  // binds on the active unit, for uploads that do not care which one
+  void bind_texture(GLenum target, GLuint texture) {
+    int t = target_index(target);
+    if (_active_unit == unknown || _active_unit >= max_units || t < 0) {
+      stats.issued++;
+      glBindTexture(target, texture);
+      return;
+    }
+    if (changed(_textures[_active_unit][t], texture)) {
+      glBindTexture(target, texture);
+    }
+  }
+
+  void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+    int t = target_index(target);
+    if (unit < max_units && t >= 0 && _textures[unit][t] == texture) {
+      stats.skipped++;
+      return;
+    }
+    active_texture(unit);
+    bind_texture(target, texture);
+  }
+
+  void enable(GLenum cap, bool on) {
+    int c = cap_index(cap);
+    if (c < 0) {
+      stats.issued++;
+      on ? glEnable(cap) : glDisable(cap);
+      return;
+    }
+    if (changed(_caps[c], on)) {
+      on ? glEnable(cap) : glDisable(cap);
+    }
+  }
+
+  void depth_mask(bool on) {
+    if (changed(_depth_mask, on)) {
+      glDepthMask(on ? GL_TRUE : GL_FALSE);
+    }
+  }
+
+  void depth_func(GLenum func) {
+    if (changed(_depth_func, func)) {
+      glDepthFunc(func);
+    }
+  }
+
+  void delete_textures(GLsizei n, const GLuint *textures) {
+    for (GLsizei i = 0; i < n; i++) {
+      for (auto &unit : _textures) {
+        for (uint32_t &bound : unit) {
+          bound = bound == textures[i] ? 0 : bound;
+        }
+      }
+    }
+    glDeleteTextures(n, textures);
+  }
+
+  void delete_buffers(GLsizei n, const GLuint *buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+      _array_buffer = _array_buffer == buffers[i] ? 0 : _array_buffer;
+    }
+    glDeleteBuffers(n, buffers);
+  }
+
+  // a program in use is only flagged for deletion, so it is unbound first
+  void delete_program(GLuint program) {
+    if (_program == program || _program == unknown) {
+      use_program(0);
+    }
+    glDeleteProgram(program);
+  }
+
+  void delete_vertex_arrays(GLsizei n, const GLuint *vaos) {
+    for (GLsizei i = 0; i < n; i++) {
+      _vao = _vao == vaos[i] ? 0 : _vao;
+    }
+    glDeleteVertexArrays(n, vaos);
+  }
+
+  // forgets everything, the next call of each kind reaches the driver
+  void invalidate() {
+    _program = _vao = _array_buffer = _active_unit = unknown;
+    _depth_mask = _depth_func = unknown;
+    for (auto &unit : _textures) {
+      for (uint32_t &bound : unit) {
+        bound = unknown;
+      }
+    }
+    for (uint32_t &cap : _caps) {
+      cap = unknown;
+    }
+  }
+
+private:
+  static constexpr uint32_t unknown = ~0u;
+  static constexpr GLenum targets[] = {GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP,
+                                       GL_TEXTURE_BUFFER};
+  static constexpr GLenum caps[] = {GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE};
+
+  uint32_t _program;
+  uint32_t _vao;
+  uint32_t _array_buffer;
+  uint32_t _active_unit;
+  uint32_t _textures[max_units][std::size(targets)];
+  uint32_t _caps[std::size(caps)];
+  uint32_t _depth_mask;
+  uint32_t _depth_func;
+
+  bool changed(uint32_t &shadow, uint32_t value) {
+    if (shadow == value) {
+      stats.skipped++;
+      return false;
+    }
+    shadow = value;
+    stats.issued++;
+    return true;
+  }
+
+  static int target_index(GLenum target) {
+    for (size_t i = 0; i < std::size(targets); i++) {
+      if (targets[i] == target) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  static int cap_index(GLenum cap) {
+    for (size_t i = 0; i < std::size(caps); i++) {
+      if (caps[i] == cap) {
+        return i;
+      }
+    }
+    return -1;
+  }
+};
+
+inline gl_state_t gl_state;
+
+} // namespace cs7gv3::common
@@ -0,0 +1,746 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cs7gv3::common {
+
+namespace detail {
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p)) {
+    p++;
+  }
+  return p;
+}
+
+inline const char *skip_token(const char *p, const char *end) {
+  while (p < end && !is_space(*p) && *p != '\n') {
+    p++;
+  }
+  return p;
+}
+
+inline const char *line_end(const char *p, const char *end) {
+  const char *eol =
+      static_cast<const char *>(std::memchr(p, '\n', end - p));
+  return eol ? eol : end;
+}
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// bounded replacement for strtof: the mapped files are not NUL terminated and
+// the locale aware libc version is a large part of the import time.
+inline float parse_float(const char *&p, const char *end) {
+  static constexpr double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                     1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                     1e18, 1e19, 1e20, 1e21, 1e22};
+
+  p = skip_space(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  for (; p < end && is_digit(*p); p++) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && is_digit(*p); p++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negative_exp = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negative_exp = *q == '-';
+      q++;
+    }
+    if (q < end && is_digit(*q)) {
+      int e = 0;
+      for (; q < end && is_digit(*q); q++) {
+        e = std::min(e * 10 + (*q - '0'), 9999);
+      }
+      exponent += negative_exp ? -e : e;
+      p = q;
+    }
+  }
+
+  double value = (double)mantissa;
+  if (exponent >= -22 && exponent <= 22) {
+    value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+  } else {
+    value *= std::pow(10.0, exponent);
+  }
+  return (float)(negative ? -value : value);
+}
+
+inline long parse_int(const char *&p, const char *end) {
+  p = skip_space(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  long value = 0;
+  for (; p < end && is_digit(*p); p++) {
+    value = value * 10 + (*p - '0');
+  }
+  return negative ? -value : value;
+}
+
+inline std::string parse_rest(const char *p, const char *end) {
+  p = skip_space(p, end);
+  while (end > p && is_space(end[-1])) {
+    end--;
+  }
+  return std::string(p, end);
+}
+
+inline std::string directory_of(const std::string &path) {
+  size_t pos = path.find_last_of('/');
+  return pos == std::string::npos ? "" : path.substr(0, pos + 1);
+}
+
+// obj face corner, indices are already resolved to 0-based, -1 if absent
+struct corner_t {
+  int32_t v;
+  int32_t vt;
+  int32_t vn;
+
+  bool operator==(const corner_t &o) const {
+    return v == o.v && vt == o.vt && vn == o.vn;
+  }
+};
+
+struct corner_hash_t {
+  size_t operator()(const corner_t &c) const {
+    uint64_t h = (uint64_t)(uint32_t)c.v * 0x9e3779b97f4a7c15ull;
+    h ^= (uint64_t)(uint32_t)c.vt * 0xc2b2ae3d27d4eb4full + (h << 6);
+    h ^= (uint64_t)(uint32_t)c.vn * 0x165667b19e3779f9ull + (h >> 2);
+    return h;
+  }
+};
+
+inline std::unordered_map<std::string, material_ref_t>
+parse_mtl(const std::string &path) {
+  std::unordered_map<std::string, material_ref_t> materials;
+
+  mapped_file_t file(path);
+  if (!file.valid()) {
+    LOG_ERR("failed to open material library: %s", path.c_str());
+    return materials;
+  }
+
+  const char *p = reinterpret_cast<const char *>(file.data());
+  const char *end = p + file.size();
+  material_ref_t *current = nullptr;
+  while (p < end) {
+    const char *eol = line_end(p, end);
+    const char *q = skip_space(p, eol);
+    const char *key_end = skip_token(q, eol);
+    std::string key(q, key_end);
+
+    // options such as "-bm 1.0" may precede the file name, which is last
+    std::string value = parse_rest(key_end, eol);
+    size_t last_space = value.find_last_of(" \t");
+    std::string file_name =
+        last_space == std::string::npos ? value : value.substr(last_space + 1);
+
+    if (key == "newmtl") {
+      current = &materials[value];
+    } else if (current && key == "map_Kd") {
+      current->diffuse_map = file_name;
+    } else if (current && (key == "map_Bump" || key == "map_bump" ||
+                           key == "bump" || key == "norm")) {
+      current->normal_map = file_name;
+    } else if (current && key == "map_Ks") {
+      current->specular_map = file_name;
+    }
+
+    p = eol + 1;
+  }
+
+  return materials;
+}
+
+} // namespace detail
+
+inline void compute_normals(mesh_data_t &mesh) {
+  for (auto &v : mesh.vertices) {
+    v.normal = glm::vec3(0.0f);
+  }
+
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    vertex_t &a = mesh.vertices[mesh.indices[i]];
+    vertex_t &b = mesh.vertices[mesh.indices[i + 1]];
+    vertex_t &c = mesh.vertices[mesh.indices[i + 2]];
+    // area weighted, the cross product is not normalized on purpose
+    glm::vec3 n = glm::cross(b.position - a.position, c.position - a.position);
+    a.normal += n;
+    b.normal += n;
+    c.normal += n;
+  }
+
+  for (auto &v : mesh.vertices) {
+    float len = glm::length(v.normal);
+    v.normal = len > 0.0f ? v.normal / len : glm::vec3(0.0f, 1.0f, 0.0f);
+  }
+}
+
+inline void compute_tangents(mesh_data_t &mesh) {
+  for (auto &v : mesh.vertices) {
+    v.tangent = glm::vec3(0.0f);
+    v.bitangent = glm::vec3(0.0f);
+  }
+
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    vertex_t &a = mesh.vertices[mesh.indices[i]];
+    vertex_t &b = mesh.vertices[mesh.indices[i + 1]];
+    vertex_t &c = mesh.vertices[mesh.indices[i + 2]];
+
+    glm::vec3 e1 = b.position - a.position;
+    glm::vec3 e2 = c.position - a.position;
+    glm::vec2 d1 = b.texture_coordinate - a.texture_coordinate;
+    glm::vec2 d2 = c.texture_coordinate - a.texture_coordinate;
+
+    float det = d1.x * d2.y - d2.x * d1.y;
+    if (det == 0.0f) {
+      continue;
+    }
+    float r = 1.0f / det;
+    glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+    glm::vec3 bt = (e2 * d1.x - e1 * d2.x) * r;
+
+    a.tangent += t;
+    b.tangent += t;
+    c.tangent += t;
+    a.bitangent += bt;
+    b.bitangent += bt;
+    c.bitangent += bt;
+  }
+
+  for (auto &v : mesh.vertices) {
+    // Gram-Schmidt against the normal
+    glm::vec3 t = v.tangent - v.normal * glm::dot(v.normal, v.tangent);
+    float len = glm::length(t);
+    v.tangent = len > 0.0f ? t / len : glm::vec3(0.0f);
+    len = glm::length(v.bitangent);
+    v.bitangent = len > 0.0f ? v.bitangent / len : glm::vec3(0.0f);
+  }
+}
+
+namespace detail {
+
+// files below this size are parsed on the calling thread only
+constexpr size_t parallel_min_chunk = 64 * 1024;
+
+// splits [begin, end) into up to n ranges that start at the beginning of a
+// line, so every record is parsed by exactly one chunk.
+inline std::vector<std::pair<const char *, const char *>>
+split_lines(const char *begin, const char *end, size_t n) {
+  std::vector<std::pair<const char *, const char *>> chunks;
+  size_t size = end - begin;
+  n = std::max<size_t>(1, std::min(n, size / parallel_min_chunk));
+
+  const char *p = begin;
+  for (size_t i = 1; i <= n && p < end; i++) {
+    const char *q = i == n ? end : begin + size * i / n;
+    if (q < p) {
+      q = p;
+    }
+    q = q < end ? line_end(q, end) : end;
+    q = q < end ? q + 1 : end;
+    chunks.emplace_back(p, q);
+    p = q;
+  }
+  return chunks;
+}
+
+inline size_t chunk_count() { return thread_pool().size() * 4; }
+
+// obj indices are global, or relative to the records seen so far when they
+// are negative. relative ones are stored against the start of the chunk and
+// rebased once all chunks know how many records came before them.
+struct obj_corner_t {
+  corner_t c;
+  uint8_t chunk_relative; // bit 0: v, bit 1: vt, bit 2: vn
+};
+
+// faces of a chunk that go into the same mesh, deduplicated within the
+// chunk. merging the runs in file order gives what one pass over the whole
+// file would.
+struct obj_run_t {
+  bool split = false; // starts at a usemtl record
+  const material_ref_t *material = nullptr;
+  bool has_normals = true;
+  std::vector<corner_t> keys; // the corner of every vertex
+  std::vector<vertex_t> vertices;
+  std::vector<uint32_t> indices; // into vertices
+  std::vector<uint32_t> remap;   // vertices into the mesh's
+  size_t mesh = 0, first_index = 0;
+};
+
+struct obj_chunk_t {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<obj_corner_t> corners;
+  std::vector<uint32_t> face_sizes;
+  // usemtl records, keyed by the index of the first face they apply to
+  std::vector<std::pair<size_t, std::string>> materials;
+  std::string mtllib;
+
+  size_t base_v = 0, base_vt = 0, base_vn = 0;
+  std::vector<obj_run_t> runs;
+};
+
+inline int32_t parse_obj_index(long idx, size_t local_count, uint8_t bit,
+                               uint8_t &chunk_relative) {
+  if (idx > 0) {
+    return (int32_t)(idx - 1);
+  }
+  if (idx < 0) {
+    chunk_relative |= bit;
+    return (int32_t)((long)local_count + idx);
+  }
+  return -1;
+}
+
+inline void parse_obj_chunk(const char *p, const char *end,
+                            obj_chunk_t &chunk) {
+  while (p < end) {
+    const char *eol = line_end(p, end);
+    const char *q = skip_space(p, eol);
+    const char *key_end = skip_token(q, eol);
+    size_t key_len = key_end - q;
+
+    if (key_len == 1 && q[0] == 'v') {
+      glm::vec3 v;
+      v.x = parse_float(key_end, eol);
+      v.y = parse_float(key_end, eol);
+      v.z = parse_float(key_end, eol);
+      chunk.positions.push_back(v);
+    } else if (key_len == 2 && q[0] == 'v' && q[1] == 'n') {
+      glm::vec3 n;
+      n.x = parse_float(key_end, eol);
+      n.y = parse_float(key_end, eol);
+      n.z = parse_float(key_end, eol);
+      chunk.normals.push_back(n);
+    } else if (key_len == 2 && q[0] == 'v' && q[1] == 't') {
+      glm::vec2 t;
+      t.x = parse_float(key_end, eol);
+      t.y = parse_float(key_end, eol);
+      chunk.uvs.push_back(t);
+    } else if (key_len == 1 && q[0] == 'f') {
+      uint32_t n = 0;
+      const char *r = skip_space(key_end, eol);
+      while (r < eol) {
+        const char *start = r;
+        obj_corner_t oc{{-1, -1, -1}, 0};
+        corner_t &c = oc.c;
+        c.v = parse_obj_index(parse_int(r, eol), chunk.positions.size(), 1,
+                              oc.chunk_relative);
+        if (r == start) {
+          break;
+        }
+        if (r < eol && *r == '/') {
+          r++;
+          if (r < eol && *r != '/') {
+            c.vt = parse_obj_index(parse_int(r, eol), chunk.uvs.size(), 2,
+                                   oc.chunk_relative);
+          }
+          if (r < eol && *r == '/') {
+            r++;
+            c.vn = parse_obj_index(parse_int(r, eol), chunk.normals.size(), 4,
+                                   oc.chunk_relative);
+          }
+        }
+        chunk.corners.push_back(oc);
+        n++;
+        r = skip_space(r, eol);
+      }
+      chunk.face_sizes.push_back(n);
+    } else if (key_len == 6 && std::strncmp(q, "usemtl", 6) == 0) {
+      chunk.materials.emplace_back(chunk.face_sizes.size(),
+                                   parse_rest(key_end, eol));
+    } else if (key_len == 6 && std::strncmp(q, "mtllib", 6) == 0) {
+      chunk.mtllib = parse_rest(key_end, eol);
+    }
+
+    p = eol + 1;
+  }
+}
+
+// fan triangulates the faces of a chunk into runs, an invalid corner starts
+// a new fan. whether a usemtl record really starts a new mesh depends on
+// the chunks before, so the run only records it.
+inline void triangulate_obj_chunk(
+    obj_chunk_t &chunk, const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec3> &normals, const std::vector<glm::vec2> &uvs,
+    const std::unordered_map<std::string, material_ref_t> &materials) {
+  std::unordered_map<corner_t, uint32_t, corner_hash_t> lookup;
+  chunk.runs.emplace_back();
+
+  // the usemtl records before face f, including those after the last face
+  size_t next_material = 0;
+  auto use_materials = [&](size_t f) {
+    for (; next_material < chunk.materials.size() &&
+           chunk.materials[next_material].first == f;
+         next_material++) {
+      if (!chunk.runs.back().vertices.empty()) {
+        chunk.runs.emplace_back();
+        lookup.clear();
+      }
+      obj_run_t &run = chunk.runs.back();
+      run.split = true;
+      auto it = materials.find(chunk.materials[next_material].second);
+      if (it != materials.end()) {
+        run.material = &it->second;
+      }
+    }
+  };
+
+  const obj_corner_t *corner = chunk.corners.data();
+  for (size_t f = 0; f < chunk.face_sizes.size(); f++) {
+    use_materials(f);
+
+    obj_run_t &run = chunk.runs.back();
+    uint32_t first = 0, prev = 0, fan = 0;
+    uint32_t n = chunk.face_sizes[f];
+    for (uint32_t i = 0; i < n; i++) {
+      const corner_t &c = corner[i].c;
+      if (c.v < 0 || (size_t)c.v >= positions.size()) {
+        fan = 0;
+        continue;
+      }
+
+      auto [it, inserted] =
+          lookup.try_emplace(c, (uint32_t)run.vertices.size());
+      if (inserted) {
+        vertex_t v{};
+        v.position = positions[c.v];
+        if (c.vn >= 0 && (size_t)c.vn < normals.size()) {
+          v.normal = normals[c.vn];
+        } else {
+          run.has_normals = false;
+        }
+        if (c.vt >= 0 && (size_t)c.vt < uvs.size()) {
+          // flipped to match the images, which are loaded top row first
+          v.texture_coordinate = {uvs[c.vt].x, 1.0f - uvs[c.vt].y};
+        }
+        run.keys.push_back(c);
+        run.vertices.push_back(v);
+      }
+
+      // fan triangulation for quads and n-gons
+      uint32_t idx = it->second;
+      if (fan == 0) {
+        first = idx;
+      } else if (fan >= 2) {
+        run.indices.push_back(first);
+        run.indices.push_back(prev);
+        run.indices.push_back(idx);
+      }
+      prev = idx;
+      fan++;
+    }
+    corner += n;
+  }
+  use_materials(chunk.face_sizes.size());
+}
+
+} // namespace detail
+
+inline std::vector<mesh_data_t> import_obj(const std::string &path) {
+  using namespace detail;
+
+  std::vector<mesh_data_t> meshes;
+
+  mapped_file_t file(path);
+  if (!file.valid()) {
+    LOG_ERR("failed to open model: %s", path.c_str());
+    return meshes;
+  }
+
+  // 1. parse line aligned chunks in parallel
+  const char *begin = reinterpret_cast<const char *>(file.data());
+  auto ranges = split_lines(begin, begin + file.size(), chunk_count());
+  std::vector<obj_chunk_t> chunks(ranges.size());
+  parallel_for(chunks.size(), [&](size_t i) {
+    parse_obj_chunk(ranges[i].first, ranges[i].second, chunks[i]);
+  });
+
+  // 2. every chunk learns how many records precede it
+  size_t n_v = 0, n_vt = 0, n_vn = 0;
+  std::string mtllib;
+  for (auto &chunk : chunks) {
+    chunk.base_v = n_v;
+    chunk.base_vt = n_vt;
+    chunk.base_vn = n_vn;
+    n_v += chunk.positions.size();
+    n_vt += chunk.uvs.size();
+    n_vn += chunk.normals.size();
+    if (mtllib.empty()) {
+      mtllib = chunk.mtllib;
+    }
+  }
+
+  std::unordered_map<std::string, material_ref_t> materials;
+  if (!mtllib.empty()) {
+    materials = parse_mtl(directory_of(path) + mtllib);
+  }
+
+  // 3. concatenate the attribute streams and rebase relative indices
+  std::vector<glm::vec3> positions(n_v), normals(n_vn);
+  std::vector<glm::vec2> uvs(n_vt);
+  parallel_for(chunks.size(), [&](size_t i) {
+    obj_chunk_t &chunk = chunks[i];
+    std::copy(chunk.positions.begin(), chunk.positions.end(),
+              positions.begin() + chunk.base_v);
+    std::copy(chunk.normals.begin(), chunk.normals.end(),
+              normals.begin() + chunk.base_vn);
+    std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.base_vt);
+
+    for (auto &oc : chunk.corners) {
+      oc.c.v += (oc.chunk_relative & 1) ? chunk.base_v : 0;
+      oc.c.vt += (oc.chunk_relative & 2) ? chunk.base_vt : 0;
+      oc.c.vn += (oc.chunk_relative & 4) ? chunk.base_vn : 0;
+    }
+  });
+
+  // 4. triangulate the chunks on their own
+  parallel_for(chunks.size(), [&](size_t i) {
+    triangulate_obj_chunk(chunks[i], positions, normals, uvs, materials);
+  });
+
+  // 5. merge the runs in file order, split on usemtl. only the vertices
+  // unique within a chunk are looked up again, by position index rather
+  // than by hash: the vertices of a mesh that share a position are chained.
+  constexpr uint32_t none = UINT32_MAX;
+  std::vector<uint32_t> first(n_v, none), next;
+  std::vector<corner_t> keys; // of every vertex of the mesh
+  std::vector<bool> has_normals;
+  std::vector<size_t> index_counts;
+  std::vector<obj_run_t *> runs;
+  meshes.emplace_back();
+  has_normals.push_back(true);
+  index_counts.push_back(0);
+  for (auto &chunk : chunks) {
+    for (auto &run : chunk.runs) {
+      if (run.split && index_counts.back() > 0) {
+        meshes.emplace_back();
+        has_normals.push_back(true);
+        index_counts.push_back(0);
+        for (const corner_t &c : keys) {
+          first[c.v] = none;
+        }
+        keys.clear();
+        next.clear();
+      }
+      mesh_data_t &mesh = meshes.back();
+      if (run.material) {
+        mesh.material = *run.material;
+      }
+      has_normals.back() = has_normals.back() && run.has_normals;
+
+      run.remap.resize(run.vertices.size());
+      for (size_t k = 0; k < run.vertices.size(); k++) {
+        const corner_t &c = run.keys[k];
+        uint32_t *link = &first[c.v];
+        while (*link != none && !(keys[*link] == c)) {
+          link = &next[*link];
+        }
+        uint32_t index = *link;
+        if (index == none) {
+          // link may point into next, so it is set before next grows
+          index = *link = (uint32_t)mesh.vertices.size();
+          keys.push_back(c);
+          next.push_back(none);
+          mesh.vertices.push_back(run.vertices[k]);
+        }
+        run.remap[k] = index;
+      }
+      run.mesh = meshes.size() - 1;
+      run.first_index = index_counts.back();
+      index_counts.back() += run.indices.size();
+      runs.push_back(&run);
+    }
+  }
+
+  for (size_t i = 0; i < meshes.size(); i++) {
+    meshes[i].indices.resize(index_counts[i]);
+  }
+  parallel_for(runs.size(), [&](size_t i) {
+    const obj_run_t &run = *runs[i];
+    uint32_t *out = meshes[run.mesh].indices.data() + run.first_index;
+    for (uint32_t idx : run.indices) {
+      *out++ = run.remap[idx];
+    }
+  });
+
+  if (meshes.back().indices.empty()) {
+    meshes.pop_back();
+  }
+
+  // 6. per mesh attributes
+  parallel_for(meshes.size(), [&](size_t i) {
+    if (!has_normals[i]) {
+      compute_normals(meshes[i]);
+    }
+    compute_tangents(meshes[i]);
+  });
+
+  return meshes;
+}
+
+inline std::vector<mesh_data_t> import_off(const std::string &path) {
+  using namespace detail;
+
+  std::vector<mesh_data_t> meshes;
+
+  mapped_file_t file(path);
+  if (!file.valid()) {
+    LOG_ERR("failed to open model: %s", path.c_str());
+    return meshes;
+  }
+
+  // OFF records are positional, so index the data lines first. the "OFF"
+  // magic and comments are skipped.
+  const char *p = reinterpret_cast<const char *>(file.data());
+  const char *end = p + file.size();
+  std::vector<const char *> lines;
+  while (p < end) {
+    const char *eol = line_end(p, end);
+    const char *q = skip_space(p, eol);
+    if (q < eol && *q != '#' &&
+        !(eol - q >= 3 && !std::strncmp(q, "OFF", 3))) {
+      lines.push_back(q);
+    }
+    p = eol + 1;
+  }
+  if (lines.empty()) {
+    LOG_ERR("empty OFF file: %s", path.c_str());
+    return meshes;
+  }
+
+  const char *q = lines[0];
+  const char *eol = line_end(q, end);
+  long vertex_count = parse_int(q, eol);
+  long face_count = parse_int(q, eol);
+  if (vertex_count < 0 || face_count < 0) {
+    LOG_ERR("invalid OFF counts: %s", path.c_str());
+    return meshes;
+  }
+  size_t n_vertices = vertex_count;
+  size_t n_faces = face_count;
+  if (lines.size() < 1 + n_vertices + n_faces) {
+    LOG_ERR("truncated OFF file: %s", path.c_str());
+    return meshes;
+  }
+
+  mesh_data_t mesh;
+  mesh.vertices.resize(n_vertices);
+  std::vector<std::vector<uint32_t>> face_indices(chunk_count());
+
+  size_t n_chunks = face_indices.size();
+  // set by any face with a missing or out of range index
+  std::atomic<bool> malformed{false};
+  parallel_for(n_chunks, [&](size_t c) {
+    for (size_t i = n_vertices * c / n_chunks;
+         i < n_vertices * (c + 1) / n_chunks; i++) {
+      const char *r = lines[1 + i];
+      const char *eol = line_end(r, end);
+      vertex_t &v = mesh.vertices[i];
+      v = vertex_t{};
+      v.position.x = parse_float(r, eol);
+      v.position.y = parse_float(r, eol);
+      v.position.z = parse_float(r, eol);
+    }
+
+    std::vector<uint32_t> &indices = face_indices[c];
+    for (size_t i = n_faces * c / n_chunks; i < n_faces * (c + 1) / n_chunks;
+         i++) {
+      const char *r = lines[1 + n_vertices + i];
+      const char *eol = line_end(r, end);
+      long n = parse_int(r, eol);
+      uint32_t first = 0, prev = 0;
+      for (long j = 0; j < n; j++) {
+        r = skip_space(r, eol);
+        const char *start = r;
+        long value = parse_int(r, eol);
+        if (r == start || value < 0 || (size_t)value >= n_vertices) {
+          malformed = true;
+          return;
+        }
+        uint32_t idx = (uint32_t)value;
+        if (j == 0) {
+          first = idx;
+        } else if (j >= 2) {
+          indices.push_back(first);
+          indices.push_back(prev);
+          indices.push_back(idx);
+        }
+        prev = idx;
+      }
+    }
+  });
+
+  if (malformed) {
+    LOG_ERR("invalid OFF face index: %s", path.c_str());
+    return meshes;
+  }
+
+  for (const auto &indices : face_indices) {
+    mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+  }
+
+  compute_normals(mesh);
+  compute_tangents(mesh);
+  meshes.push_back(std::move(mesh));
+
+  return meshes;
+}
+
+inline std::vector<mesh_data_t> import_model(const std::string &path) {
+  size_t dot = path.find_last_of('.');
+  std::string ext = dot == std::string::npos ? "" : path.substr(dot + 1);
+
+  if (ext == "obj") {
+    return import_obj(path);
+  }
+  if (ext == "off") {
+    return import_off(path);
+  }
+
+  LOG_ERR("unsupported model format: %s", path.c_str());
+  return {};
+}
+
+} // namespace cs7gv3::common
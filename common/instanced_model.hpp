@@ -0,0 +1,273 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "model.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// One model drawn many times: the meshes are loaded and uploaded once, the
+// instances in view live in a per-instance vertex buffer, grouped by LOD,
+// and every mesh is one glDrawElementsInstanced per group however many
+// instances there are.
+namespace cs7gv3::common {
+
+// what a vertex shader reads per instance, after the five vertex attributes
+// of vertex_t. the instance is placed inside the object's transform.
+#define CS7GV3_INSTANCE_GLSL                                                   \
+  "layout(location = 5) in mat4 instance_transform;\n"                         \
+  "layout(location = 9) in mat3 instance_normal_matrix;\n"                     \
+  "layout(location = 12) in vec3 instance_color;\n"
+
+struct instance_t {
+  glm::mat4 transform = glm::mat4(1.0f);
+  // filled in from transform when the instances are uploaded
+  glm::mat3 normal_matrix = glm::mat3(1.0f);
+  // multiplies the material's base colour
+  glm::vec3 color = glm::vec3(1.0f);
+};
+
+class instanced_model_t : public model_t {
+public:
+  // the instance attributes go on each mesh's own vertex array, pooled
+  // meshes share theirs
+  instanced_model_t(const std::string &path, figine::core::camera_t *camera,
+                    bool gamma_correction = false)
+      : model_t(path, camera, gamma_correction) {
+    pooled_geometry = false;
+  }
+
+  ~instanced_model_t() {
+    if (_buffer && glfwGetCurrentContext()) {
+      gl_state.delete_buffers(1, &_buffer);
+    }
+  }
+
+  // set instances_dirty after editing, the normal matrices are rebuilt on
+  // the next cull()
+  std::vector<instance_t> instances = {instance_t{}};
+  bool instances_dirty = true;
+
+  // culls every instance against the frustum and the occlusion copy, spread
+  // over the pool for large counts, picks the LOD of each survivor and
+  // uploads them back to back, grouped by LOD and fade. the buffer is only
+  // rewritten when that order changed. instances count in cull_stats, not
+  // meshes.
+  void cull(const frustum_t &frustum) override {
+    if (instances_dirty) {
+      for (instance_t &instance : instances) {
+        instance.normal_matrix =
+            glm::transpose(glm::inverse(glm::mat3(instance.transform)));
+      }
+    }
+
+    bool any = std::any_of(_meshes.begin(), _meshes.end(),
+                           [](const mesh_t &mesh) { return mesh.resident(); });
+    size_t n = 0;
+    _levels.resize(instances.size());
+    if (any) {
+      // uncertain instances are drawn, they share one draw with the rest
+      std::atomic<size_t> tested{0}, occluded{0};
+      n = cull_parallel(instances.size(), _visible, [&](size_t i) {
+        glm::mat4 placed = transform * instances[i].transform;
+        bounds_t world = bounds().transformed(placed);
+        if (frustum_culling && !frustum.visible(world)) {
+          return false;
+        }
+        if (occlusion) {
+          tested++;
+          if (occlusion->test(world) == occlusion_t::result_t::occluded) {
+            occluded++;
+            return false;
+          }
+        }
+        _levels[i] = select_level(placed);
+        return true;
+      });
+      cull_stats.visible += n;
+      cull_stats.culled += instances.size() - n;
+      occlusion_stats.tested += tested;
+      occlusion_stats.occluded += occluded;
+    }
+
+    if (any) {
+      group(n);
+    }
+    if (any && (instances_dirty || _order != _uploaded)) {
+      upload();
+      _uploaded = _order;
+      instances_dirty = false;
+    }
+
+    _mesh_visible.assign(_meshes.size(), 0);
+    for (size_t i = 0; i < _meshes.size(); i++) {
+      _mesh_visible[i] = _meshes[i].resident() && _count > 0;
+    }
+  }
+
+  // one draw per group, at the group's LOD, a fading group twice
+  void draw_mesh(const figine::core::shader_if &shader, size_t i) override {
+    const mesh_t &mesh = _meshes[i];
+    _attached.resize(_meshes.size(), none);
+    for (const group_t &g : _groups) {
+      if (_attached[i] != g.first) {
+        attach(mesh, g.first);
+        _attached[i] = g.first;
+      }
+      if (g.step == fade_steps) {
+        mesh.draw(g.current, 0.0f, g.count);
+        continue;
+      }
+      float t = (float)g.step / fade_steps;
+      if (g.step > 0) {
+        mesh.draw(g.current, t, g.count);
+      }
+      mesh.draw(g.previous, t - 1.0f, g.count);
+    }
+  }
+
+private:
+  static constexpr size_t none = SIZE_MAX;
+  // the dither pattern of CS7GV3_LOD_FADE_GLSL has 16 thresholds, a fade
+  // rounded down to sixteenths draws the same pixels
+  static constexpr uint32_t fade_steps = 16;
+
+  // a run of the instance buffer at one LOD, fading in from previous when
+  // step is below fade_steps
+  struct group_t {
+    size_t first;
+    uint32_t count;
+    uint32_t current;
+    uint32_t previous;
+    uint32_t step;
+  };
+
+  GLuint _buffer = 0;
+  size_t _capacity = 0;
+  // instances in the buffer
+  size_t _count = 0;
+  // per mesh, the instance its attributes start at
+  std::vector<size_t> _attached;
+  std::vector<uint8_t> _visible;
+  // per instance, the LOD of the last cull() and the fade towards it
+  std::vector<uint32_t> _levels;
+  std::vector<lod_state_t> _fades;
+  // the visible instances in buffer order, and as last uploaded
+  std::vector<uint32_t> _order;
+  std::vector<uint32_t> _uploaded;
+  std::vector<uint32_t> _steps;
+  std::vector<group_t> _groups;
+  std::vector<instance_t> _staging;
+
+  // the finest level any mesh asks for, each mesh clamps it to its own
+  uint32_t select_level(const glm::mat4 &placed) const {
+    size_t level = SIZE_MAX;
+    for (const mesh_t &mesh : _meshes) {
+      if (mesh.lods.size() > 1) {
+        level = std::min(level, select_lod(mesh, placed));
+      }
+    }
+    return level == SIZE_MAX ? 0 : level;
+  }
+
+  // sorts the visible instances into groups of one LOD and fade step
+  void group(size_t n) {
+    _fades.resize(instances.size());
+    double now = glfwGetTime();
+    auto key = [this](uint32_t i) {
+      const lod_state_t &f = _fades[i];
+      return std::make_tuple(f.current, f.previous, _steps[i]);
+    };
+
+    _order.clear();
+    _order.reserve(n);
+    _steps.resize(instances.size());
+    for (uint32_t i = 0; i < instances.size(); i++) {
+      if (!_visible[i]) {
+        continue;
+      }
+      lod_state_t &fade = _fades[i];
+      if (!lod_cross_fade) {
+        fade = {_levels[i], _levels[i], now};
+      }
+      float t = fade_to(fade, _levels[i], now);
+      _steps[i] = std::min((uint32_t)(t * fade_steps), fade_steps);
+      // a finished fade groups with the instances that never faded
+      if (_steps[i] == fade_steps) {
+        fade.previous = fade.current;
+      }
+      _order.push_back(i);
+    }
+    std::stable_sort(_order.begin(), _order.end(),
+                     [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+    _groups.clear();
+    for (size_t j = 0; j < _order.size(); j++) {
+      uint32_t i = _order[j];
+      const lod_state_t &f = _fades[i];
+      if (_groups.empty() || key(_order[j - 1]) != key(i)) {
+        _groups.push_back({j, 0, (uint32_t)f.current, (uint32_t)f.previous,
+                           _steps[i]});
+      }
+      _groups.back().count++;
+    }
+  }
+
+  void upload() {
+    size_t n = _order.size();
+    _staging.clear();
+    _staging.reserve(n);
+    for (uint32_t i : _order) {
+      _staging.push_back(instances[i]);
+    }
+    _count = n;
+    if (n == 0) {
+      return;
+    }
+
+    if (_buffer == 0) {
+      glGenBuffers(1, &_buffer);
+    }
+    gl_state.bind_array_buffer(_buffer);
+    if (n > _capacity) {
+      _capacity = std::max(n, _capacity * 2);
+      glBufferData(GL_ARRAY_BUFFER, _capacity * sizeof(instance_t), nullptr,
+                   GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(instance_t),
+                    _staging.data());
+  }
+
+  // points the instance attributes of a mesh's vertex array at the buffer
+  // from instance first on, they advance once per instance. GL 4.1 has no
+  // base instance, so each group moves the pointers instead.
+  void attach(const mesh_t &mesh, size_t first) {
+    gl_state.bind_vertex_array(mesh.vao);
+    defer(gl_state.bind_vertex_array(0));
+    gl_state.bind_array_buffer(_buffer);
+
+    size_t base = first * sizeof(instance_t);
+    auto attrib = [base](GLuint location, GLint size, size_t offset) {
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE,
+                            sizeof(instance_t), (void *)(base + offset));
+      glVertexAttribDivisor(location, 1);
+    };
+    for (GLuint c = 0; c < 4; c++) {
+      attrib(5 + c, 4,
+             offsetof(instance_t, transform) + c * sizeof(glm::vec4));
+    }
+    for (GLuint c = 0; c < 3; c++) {
+      attrib(9 + c, 3,
+             offsetof(instance_t, normal_matrix) + c * sizeof(glm::vec3));
+    }
+    attrib(12, 3, offsetof(instance_t, color));
+  }
+};
+
+} // namespace cs7gv3::common
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "projection.hpp"
+#include "thread_pool.hpp"
+#include "uniform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Clustered forward shading (Olsson et al. 2012): the view frustum is cut
+// into screen tiles times exponential depth slices, the lights are binned
+// into the clusters their sphere of influence touches, and a fragment only
+// loops over the lights of its own cluster. Slices are binned in parallel,
+// each owns its clusters so nothing is shared. The bins are only rebuilt
+// when the lights, the view or the projection change.
+namespace cs7gv3::common {
+
+struct cluster_grid_t {
+  int x = 16;
+  int y = 9;
+  int z = 24;
+  // depth range of the slices, that of the scene's projection
+  float near = near_plane;
+  float far = far_plane;
+
+  size_t size() const { return (size_t)x * y * z; }
+
+  // view depth at the start of slice s, slices are exponentially spaced
+  float slice_depth(int s) const {
+    return near * std::pow(far / near, (float)s / z);
+  }
+
+  // the cluster of a point, like cluster_range() in the shader
+  size_t index(const glm::vec2 &ndc, float view_depth) const {
+    int tx = std::clamp((int)((ndc.x * 0.5f + 0.5f) * x), 0, x - 1);
+    int ty = std::clamp((int)((ndc.y * 0.5f + 0.5f) * y), 0, y - 1);
+    float s = std::log(view_depth / near) / std::log(far / near);
+    int slice = std::clamp((int)(s * z), 0, z - 1);
+    return ((size_t)slice * y + ty) * x + tx;
+  }
+
+  bool operator==(const cluster_grid_t &o) const {
+    return x == o.x && y == o.y && z == o.z && near == o.near &&
+           far == o.far;
+  }
+};
+
+// splice into a fragment shader, view_depth is the distance along the view
+// direction, positive in front of the camera
+#define CS7GV3_LIGHT_CLUSTER_GLSL                                              \
+  "uniform usamplerBuffer cluster_ranges;\n"                                   \
+  "uniform usamplerBuffer cluster_lights;\n"                                   \
+  "uniform ivec3 cluster_dims;\n"                                              \
+  "uniform vec2 cluster_viewport;\n"                                           \
+  "uniform vec2 cluster_depth;\n"                                              \
+  "uvec2 cluster_range(vec2 frag_coord, float view_depth) {\n"                 \
+  "  ivec2 tile = ivec2(frag_coord / cluster_viewport * cluster_dims.xy);\n"   \
+  "  tile = clamp(tile, ivec2(0), cluster_dims.xy - 1);\n"                     \
+  "  float s = log(view_depth / cluster_depth.x) /\n"                          \
+  "            log(cluster_depth.y / cluster_depth.x);\n"                      \
+  "  int slice = clamp(int(s * cluster_dims.z), 0, cluster_dims.z - 1);\n"     \
+  "  int i = (slice * cluster_dims.y + tile.y) * cluster_dims.x + tile.x;\n"   \
+  "  return texelFetch(cluster_ranges, i).xy;\n"                               \
+  "}\n"                                                                        \
+  "int cluster_light(uint i) {\n"                                              \
+  "  return int(texelFetch(cluster_lights, int(i)).x);\n"                      \
+  "}\n"
+
+namespace cluster_uniforms {
+constexpr uniform_t ranges = "cluster_ranges";
+constexpr uniform_t lights = "cluster_lights";
+constexpr uniform_t dims = "cluster_dims";
+constexpr uniform_t viewport = "cluster_viewport";
+constexpr uniform_t depth = "cluster_depth";
+} // namespace cluster_uniforms
+
+// GL thread only, the buffers are created on the first build(). bin() alone
+// touches no GL.
+class light_clusters_t {
+public:
+  static constexpr GLuint range_unit = 14;
+  static constexpr GLuint index_unit = 13;
+
+  cluster_grid_t grid;
+
+  light_clusters_t() = default;
+
+  ~light_clusters_t() {
+    if (_buffers[0] && glfwGetCurrentContext()) {
+      gl_state.delete_textures(2, _textures);
+      gl_state.delete_buffers(2, _buffers);
+    }
+  }
+
+  light_clusters_t(const light_clusters_t &) = delete;
+  light_clusters_t &operator=(const light_clusters_t &) = delete;
+
+  // bins the lights and uploads the clusters. does nothing when called with
+  // what the last build() had.
+  void build(const std::vector<glm::vec4> &spheres, const glm::mat4 &view,
+             const glm::mat4 &projection) {
+    if (bin(spheres, view, projection)) {
+      upload();
+    }
+  }
+
+  // the CPU half of build(), any thread and no GL. spheres are world space,
+  // xyz the centre and w the radius past which a light adds nothing.
+  // projection must be a symmetric perspective. false when the input is what
+  // the last bin() had and nothing changed.
+  bool bin(const std::vector<glm::vec4> &spheres, const glm::mat4 &view,
+           const glm::mat4 &projection) {
+    if (_built && spheres == _spheres && view == _view &&
+        projection == _projection && grid == _grid) {
+      return false;
+    }
+    _built = true;
+    _spheres = spheres;
+    _view = view;
+    _projection = projection;
+    _grid = grid;
+
+    const size_t n = spheres.size();
+    const int tiles = grid.x * grid.y;
+
+    // in view space, every slice scans all of them
+    _x.resize(n), _y.resize(n), _depth.resize(n), _radius.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      glm::vec3 p = view * glm::vec4(glm::vec3(spheres[i]), 1.0f);
+      _x[i] = p.x, _y[i] = p.y, _depth[i] = -p.z, _radius[i] = spheres[i].w;
+    }
+
+    _bins.resize(grid.size());
+    const float sx = projection[0][0], sy = projection[1][1];
+    parallel_for(grid.z, [&](size_t s) {
+      const float d0 = grid.slice_depth(s), d1 = grid.slice_depth(s + 1);
+      std::vector<uint32_t> *bins = &_bins[s * tiles];
+      for (int t = 0; t < tiles; t++) {
+        bins[t].clear();
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        if (_depth[i] + _radius[i] < d0 || _depth[i] - _radius[i] > d1) {
+          continue;
+        }
+
+        // the sphere's box clipped to the slice, x / depth is monotonic in
+        // both so its corners bound the projection
+        float near = std::max(d0, _depth[i] - _radius[i]);
+        float far = std::min(d1, _depth[i] + _radius[i]);
+        float x0 = _x[i] - _radius[i], x1 = _x[i] + _radius[i];
+        float y0 = _y[i] - _radius[i], y1 = _y[i] + _radius[i];
+        float left = sx * std::min(x0 / near, x0 / far);
+        float right = sx * std::max(x1 / near, x1 / far);
+        float bottom = sy * std::min(y0 / near, y0 / far);
+        float top = sy * std::max(y1 / near, y1 / far);
+
+        int tx0 = tile(left, grid.x), tx1 = tile(right, grid.x);
+        int ty0 = tile(bottom, grid.y), ty1 = tile(top, grid.y);
+        for (int ty = ty0; ty <= ty1; ty++) {
+          for (int tx = tx0; tx <= tx1; tx++) {
+            bins[ty * grid.x + tx].push_back(i);
+          }
+        }
+      }
+    });
+
+    _ranges.resize(grid.size() * 2);
+    _indices.clear();
+    for (size_t c = 0; c < grid.size(); c++) {
+      _ranges[c * 2] = _indices.size();
+      _ranges[c * 2 + 1] = _bins[c].size();
+      _indices.insert(_indices.end(), _bins[c].begin(), _bins[c].end());
+    }
+    return true;
+  }
+
+  // points the program in use at the clusters of the last build()
+  void bind() const {
+    GLint viewport[4] = {0, 0, 1, 1};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    gl_state.bind_texture(range_unit, GL_TEXTURE_BUFFER, _textures[0]);
+    gl_state.bind_texture(index_unit, GL_TEXTURE_BUFFER, _textures[1]);
+
+    namespace u = cluster_uniforms;
+    const uniform_table_t &uniforms = current_uniforms();
+    uniforms.set(u::ranges, (int)range_unit);
+    uniforms.set(u::lights, (int)index_unit);
+    uniforms.set(u::dims, glm::ivec3(grid.x, grid.y, grid.z));
+    uniforms.set(u::viewport, glm::vec2(viewport[2], viewport[3]));
+    uniforms.set(u::depth, glm::vec2(grid.near, grid.far));
+  }
+
+  // light references over all clusters, each light counts once per cluster
+  size_t references() const { return _indices.size(); }
+
+  // the lights binned into cluster c by the last bin()
+  const std::vector<uint32_t> &lights(size_t c) const { return _bins[c]; }
+
+private:
+  GLuint _buffers[2] = {0, 0};
+  GLuint _textures[2] = {0, 0};
+  size_t _capacity[2] = {0, 0};
+
+  // what the bins were built from
+  bool _built = false;
+  std::vector<glm::vec4> _spheres;
+  glm::mat4 _view = glm::mat4(1.0f);
+  glm::mat4 _projection = glm::mat4(1.0f);
+  cluster_grid_t _grid;
+
+  std::vector<float> _x, _y, _depth, _radius;
+  std::vector<std::vector<uint32_t>> _bins;
+  std::vector<uint32_t> _ranges;
+  std::vector<uint32_t> _indices;
+
+  // ndc to a tile index, clamped to the grid
+  static int tile(float ndc, int tiles) {
+    int t = (int)std::floor((ndc * 0.5f + 0.5f) * tiles);
+    return std::clamp(t, 0, tiles - 1);
+  }
+
+  void upload() {
+    if (_buffers[0] == 0) {
+      glGenBuffers(2, _buffers);
+      glGenTextures(2, _textures);
+    }
+
+    const std::vector<uint32_t> *data[2] = {&_ranges, &_indices};
+    const GLenum formats[2] = {GL_RG32UI, GL_R32UI};
+    for (int k = 0; k < 2; k++) {
+      // a texture buffer cannot be empty
+      size_t size = std::max<size_t>(data[k]->size(), 1) * sizeof(uint32_t);
+      glBindBuffer(GL_TEXTURE_BUFFER, _buffers[k]);
+      if (size > _capacity[k]) {
+        _capacity[k] = std::max(size, _capacity[k] * 2);
+        glBufferData(GL_TEXTURE_BUFFER, _capacity[k], nullptr,
+                     GL_STREAM_DRAW);
+        gl_state.bind_texture(GL_TEXTURE_BUFFER, _textures[k]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[k], _buffers[k]);
+      }
+      if (!data[k]->empty()) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0,
+                        data[k]->size() * sizeof(uint32_t), data[k]->data());
+      }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+};
+
+} // namespace cs7gv3::common
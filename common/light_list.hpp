@@ -0,0 +1,100 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "uniform.hpp"
+#include "uniform_block.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// A list of lights of any length in a buffer object, read by the shader
+// through a texture buffer. Shader storage blocks would need GL 4.3, which
+// macOS does not have. Each light is four vec4s laid out like
+// light_block_t, a texel each.
+namespace cs7gv3::common {
+
+// splice into a fragment shader after #version
+#define CS7GV3_LIGHT_LIST_GLSL                                                 \
+  "uniform samplerBuffer light_texels;\n"                                      \
+  "vec4 light_texel(int i) { return texelFetch(light_texels, i); }\n"          \
+  "struct light_t {\n"                                                         \
+  "  vec3 position;\n"                                                         \
+  "  vec3 ambient_color;\n"                                                    \
+  "  vec3 diffuse_color;\n"                                                    \
+  "  vec3 specular_color;\n"                                                   \
+  "};\n"                                                                       \
+  "light_t fetch_light(int i) {\n"                                             \
+  "  int t = i * 4;\n"                                                         \
+  "  return light_t(light_texel(t).xyz, light_texel(t + 1).xyz,\n"             \
+  "                 light_texel(t + 2).xyz, light_texel(t + 3).xyz);\n"        \
+  "}\n"
+
+// GL thread only, the buffer is created on the first assign()
+class light_list_t {
+public:
+  // out of the way of the material textures
+  static constexpr GLuint texture_unit = 15;
+
+  light_list_t() = default;
+
+  ~light_list_t() {
+    if (!glfwGetCurrentContext()) {
+      return;
+    }
+    if (_texture) {
+      gl_state.delete_textures(1, &_texture);
+    }
+    if (_buffer) {
+      gl_state.delete_buffers(1, &_buffer);
+    }
+  }
+
+  light_list_t(const light_list_t &) = delete;
+  light_list_t &operator=(const light_list_t &) = delete;
+
+  // replaces the whole list, the buffer only grows
+  void assign(const light_block_t *lights, size_t n) {
+    if (_buffer == 0) {
+      glGenBuffers(1, &_buffer);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, _buffer);
+    if (n > _capacity) {
+      _capacity = std::max(n, _capacity * 2);
+      glBufferData(GL_TEXTURE_BUFFER, _capacity * sizeof(light_block_t),
+                   nullptr, GL_DYNAMIC_DRAW);
+    }
+    if (n > 0) {
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, n * sizeof(light_block_t),
+                      lights);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    if (_texture == 0 && _capacity > 0) {
+      glGenTextures(1, &_texture);
+      gl_state.bind_texture(GL_TEXTURE_BUFFER, _texture);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer);
+    }
+    _size = n;
+  }
+
+  // makes the list visible to the program in use. the sampler is pointed
+  // at its unit even while the list is empty, left on unit 0 it would clash
+  // with the 2D textures there.
+  void bind() {
+    gl_state.bind_texture(texture_unit, GL_TEXTURE_BUFFER, _texture);
+    uniforms(gl_state.program())
+        .set(uniform_t("light_texels"), (int)texture_unit);
+  }
+
+  size_t size() const { return _size; }
+
+private:
+  GLuint _buffer = 0;
+  GLuint _texture = 0;
+  size_t _size = 0;
+  size_t _capacity = 0;
+};
+
+} // namespace cs7gv3::common
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cs7gv3::common {
+
+// read-only view of a whole file, backed by mmap so the pages come straight
+// from the page cache and can be handed to glBufferData without a copy.
+class mapped_file_t {
+public:
+  mapped_file_t() = default;
+  explicit mapped_file_t(const std::string &path) { open(path); }
+  ~mapped_file_t() { close(); }
+
+  mapped_file_t(const mapped_file_t &) = delete;
+  mapped_file_t &operator=(const mapped_file_t &) = delete;
+
+  mapped_file_t(mapped_file_t &&other) noexcept
+      : _data(other._data), _size(other._size) {
+    other._data = nullptr;
+    other._size = 0;
+  }
+
+  mapped_file_t &operator=(mapped_file_t &&other) noexcept {
+    if (this != &other) {
+      close();
+      _data = other._data;
+      _size = other._size;
+      other._data = nullptr;
+      other._size = 0;
+    }
+    return *this;
+  }
+
+  bool open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+
+    _data = static_cast<const uint8_t *>(addr);
+    _size = st.st_size;
+    return true;
+  }
+
+  void close() {
+    if (_data) {
+      munmap(const_cast<uint8_t *>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+  }
+
+  bool valid() const { return _data != nullptr; }
+  const uint8_t *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const uint8_t *_data = nullptr;
+  size_t _size = 0;
+};
+
+// FNV-1a, good enough to notice that a model file was re-exported.
+inline uint64_t hash_bytes(const uint8_t *data, size_t size,
+                           uint64_t seed = 0xcbf29ce484222325ull) {
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// a file next to path to write and then rename over it. the name is unique
+// to the process and the call, so writers of one path on other threads or
+// in other processes never share it.
+inline std::string temp_path(const std::string &path) {
+  static std::atomic<uint64_t> counter{0};
+  return path + "." + std::to_string(getpid()) + "." +
+         std::to_string(counter++) + ".tmp";
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "packed_vertex.hpp"
+#include "static_geometry.hpp"
+#include "streamer.hpp"
+#include "texture_registry.hpp"
+#include "uniform.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cs7gv3::common {
+
+// texture paths are relative to the model file
+struct material_ref_t {
+  std::string diffuse_map;
+  std::string normal_map;
+  std::string specular_map;
+};
+
+// a range of the index buffer, level 0 is the full mesh. error is the
+// largest deviation from it in model units.
+struct lod_t {
+  uint32_t first;
+  uint32_t count;
+  float error;
+};
+
+// splice into a fragment shader after #version and call lod_dither() first
+// thing in main() to cross-fade between LODs. mesh_t::draw() sets lod_fade,
+// positive keeps that share of the pixels, negative the complement.
+#define CS7GV3_LOD_FADE_GLSL                                                   \
+  "uniform float lod_fade;\n"                                                  \
+  "void lod_dither() {\n"                                                      \
+  "  const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0,\n"      \
+  "      14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);\n"             \
+  "  if (lod_fade == 0.0) return;\n"                                           \
+  "  ivec2 p = ivec2(gl_FragCoord.xy) & 3;\n"                                  \
+  "  float d = (bayer[p.y * 4 + p.x] + 0.5) / 16.0;\n"                         \
+  "  if (lod_fade > 0.0 ? d >= lod_fade : d < 1.0 + lod_fade) discard;\n"      \
+  "}\n"
+
+struct mesh_data_t {
+  std::vector<vertex_t> vertices;
+  std::vector<uint32_t> indices; // every LOD, back to back
+  material_ref_t material;
+  std::vector<lod_t> lods;
+};
+
+// an AABB and a sphere about its centre holding every vertex, usually much
+// tighter than the one around the box
+struct bounds_t {
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+  float radius = 0.0f;
+
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+  // under an affine transform, the box grows to hold the rotated one and
+  // the sphere scales with the largest axis
+  bounds_t transformed(const glm::mat4 &m) const {
+    glm::mat3 r(m);
+    glm::vec3 c = m * glm::vec4(center(), 1.0f);
+    glm::vec3 e = extent();
+    e = glm::abs(r[0]) * e.x + glm::abs(r[1]) * e.y + glm::abs(r[2]) * e.z;
+    float scale = std::max(
+        {glm::length(r[0]), glm::length(r[1]), glm::length(r[2])});
+    return {c - e, c + e, radius * scale};
+  }
+};
+
+inline bounds_t compute_bounds(array_view_t<vertex_t> vertices) {
+  if (vertices.empty()) {
+    return {};
+  }
+
+  bounds_t bounds{vertices[0].position, vertices[0].position};
+  for (const vertex_t &v : vertices) {
+    bounds.min = glm::min(bounds.min, v.position);
+    bounds.max = glm::max(bounds.max, v.position);
+  }
+  glm::vec3 center = bounds.center();
+  float r2 = 0.0f;
+  for (const vertex_t &v : vertices) {
+    glm::vec3 d = v.position - center;
+    r2 = std::max(r2, glm::dot(d, d));
+  }
+  bounds.radius = std::sqrt(r2);
+  return bounds;
+}
+
+// holds both, for the bounds of a whole object
+inline bounds_t merge_bounds(const bounds_t &a, const bounds_t &b) {
+  bounds_t bounds{glm::min(a.min, b.min), glm::max(a.max, b.max)};
+  glm::vec3 center = bounds.center();
+  // the half diagonal holds everything too, whichever is smaller wins
+  bounds.radius = std::min(
+      std::max(glm::distance(center, a.center()) + a.radius,
+               glm::distance(center, b.center()) + b.radius),
+      glm::length(bounds.extent()));
+  return bounds;
+}
+
+struct texture_t {
+  texture_ref_t texture;
+  std::string type; // sampler prefix, e.g. "texture_diffuse"
+  uniform_t sampler; // hash of type, the draw appends the number
+};
+
+namespace mesh_uniforms {
+constexpr uniform_t position_offset = "position_offset";
+constexpr uniform_t position_scale = "position_scale";
+constexpr uniform_t lod_fade = "lod_fade";
+constexpr uniform_t has_diffuse_map = "has_diffuse_map";
+constexpr uniform_t has_normal_map = "has_normal_map";
+} // namespace mesh_uniforms
+
+// the vertex array and buffers of a mesh that is not pooled, deleted with
+// it. pooled ranges belong to their pool.
+class mesh_buffers_t {
+public:
+  mesh_buffers_t() = default;
+  mesh_buffers_t(GLuint vao, GLuint vbo, GLuint ebo)
+      : _vao(vao), _buffers{vbo, ebo} {}
+  ~mesh_buffers_t() { release(); }
+
+  mesh_buffers_t(const mesh_buffers_t &) = delete;
+  mesh_buffers_t &operator=(const mesh_buffers_t &) = delete;
+
+  mesh_buffers_t(mesh_buffers_t &&other) noexcept
+      : _vao(other._vao), _buffers{other._buffers[0], other._buffers[1]} {
+    other._vao = other._buffers[0] = other._buffers[1] = 0;
+  }
+
+  mesh_buffers_t &operator=(mesh_buffers_t &&other) noexcept {
+    if (this != &other) {
+      release();
+      _vao = other._vao;
+      _buffers[0] = other._buffers[0];
+      _buffers[1] = other._buffers[1];
+      other._vao = other._buffers[0] = other._buffers[1] = 0;
+    }
+    return *this;
+  }
+
+private:
+  GLuint _vao = 0;
+  GLuint _buffers[2] = {};
+
+  void release() {
+    if (_vao && glfwGetCurrentContext()) {
+      gl_state.delete_vertex_arrays(1, &_vao);
+      gl_state.delete_buffers(2, _buffers);
+      _vao = _buffers[0] = _buffers[1] = 0;
+    }
+  }
+};
+
+// moves but does not copy, the buffers go with it
+class mesh_t {
+public:
+  array_view_t<vertex_t> _vertices;
+  array_view_t<uint32_t> _indices;
+  // uploaded instead of _vertices when set, see packed_vertex_t
+  array_view_t<packed_vertex_t> _packed;
+  quantization_t quantization;
+  std::vector<lod_t> lods;
+  bounds_t bounds;
+  std::vector<texture_t> textures;
+  GLuint vao = 0;
+  // take a range of geometry_pool() instead of buffers of its own, set
+  // before upload() or stream(). instanced meshes keep theirs, the instance
+  // attributes go on the vertex array.
+  bool pooled = false;
+  // where the mesh starts in its buffers, 0 unless pooled
+  GLint base_vertex = 0;
+  uint32_t first_index = 0;
+
+  // creates the buffers, or takes a range of the pool, without filling them
+  void allocate() {
+    if (pooled) {
+      geometry_range_t range =
+          geometry_pool(packed()).allocate(vertex_count(), _indices.size());
+      vao = range.vao;
+      _vbo = range.vbo;
+      _ebo = range.ebo;
+      base_vertex = range.base_vertex;
+      first_index = range.first_index;
+      return;
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &_vbo);
+    glGenBuffers(1, &_ebo);
+    _owned = mesh_buffers_t(vao, _vbo, _ebo);
+
+    gl_state.bind_vertex_array(vao);
+    defer(gl_state.bind_vertex_array(0));
+
+    gl_state.bind_array_buffer(_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertex_bytes(), nullptr, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(uint32_t),
+                 nullptr, GL_STATIC_DRAW);
+    set_vertex_layout(packed());
+  }
+
+  bool packed() const { return !_packed.empty(); }
+
+  void upload() {
+    allocate();
+
+    gl_state.bind_array_buffer(_vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, vertex_offset(), vertex_bytes(),
+                    vertex_data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, index_offset(),
+                    _indices.size() * sizeof(uint32_t), _indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // like upload(), but the copies are spread over frames by the streamer.
+  // the views must outlive the upload and the mesh must not move meanwhile.
+  void stream() {
+    allocate();
+
+    _pending = 2;
+    streamer::upload_buffer(
+        _vbo, vertex_data(), vertex_bytes(), [this]() { _pending--; },
+        nullptr, vertex_offset());
+    streamer::upload_buffer(
+        _ebo, _indices.data(), _indices.size() * sizeof(uint32_t),
+        [this]() { _pending--; }, nullptr, index_offset());
+  }
+
+  bool resident() const { return vao != 0 && _pending == 0; }
+
+  // binds the textures and sets the uniforms of the mesh, except lod_fade.
+  // meshes that shares_state() leave the same behind.
+  void bind() const {
+    const uniform_table_t &uniforms = current_uniforms();
+
+    uint32_t n_diffuse = 1, n_normal = 1, n_specular = 1;
+    for (size_t i = 0; i < textures.size(); i++) {
+      uint32_t n = 1;
+      if (textures[i].type == "texture_diffuse") {
+        n = n_diffuse++;
+      } else if (textures[i].type == "texture_normal") {
+        n = n_normal++;
+      } else if (textures[i].type == "texture_specular") {
+        n = n_specular++;
+      }
+
+      uniforms.set(textures[i].sampler.append(n), (int)i);
+      gl_state.bind_texture(i, GL_TEXTURE_2D, textures[i].texture->bind_id());
+    }
+    // shaders shared by textured and plain meshes branch on these
+    uniforms.set(mesh_uniforms::has_diffuse_map, n_diffuse > 1);
+    uniforms.set(mesh_uniforms::has_normal_map, n_normal > 1);
+
+    uniforms.set(mesh_uniforms::position_offset, quantization.offset);
+    uniforms.set(mesh_uniforms::position_scale, quantization.scale);
+    if (packed()) {
+      // a zero bitangent makes the shader rebuild it from the tangent
+      glVertexAttrib3f(4, 0.0f, 0.0f, 0.0f);
+    }
+
+    gl_state.bind_vertex_array(vao);
+  }
+
+  // LOD level lod, or the coarsest there is, first counts from the start of
+  // the index buffer
+  lod_t range(size_t lod) const {
+    lod_t range = {0, (uint32_t)_indices.size(), 0.0f};
+    if (!lods.empty()) {
+      range = lods[std::min(lod, lods.size() - 1)];
+    }
+    range.first += first_index;
+    return range;
+  }
+
+  // whether a draw of other can follow one of this mesh without binding
+  // anything, then both fit in one glMultiDrawElementsBaseVertex
+  bool shares_state(const mesh_t &other) const {
+    if (vao != other.vao || packed() != other.packed() ||
+        quantization.offset != other.quantization.offset ||
+        quantization.scale != other.quantization.scale ||
+        textures.size() != other.textures.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < textures.size(); i++) {
+      if (textures[i].type != other.textures[i].type ||
+          textures[i].texture->bind_id() !=
+              other.textures[i].texture->bind_id()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // draws LOD level lod, or the coarsest there is, with the program bound
+  // last. fade is handed to CS7GV3_LOD_FADE_GLSL, 0 draws every pixel. more
+  // than one instance needs the vertex array to have instance attributes,
+  // see instanced_model_t.
+  void draw(size_t lod = 0, float fade = 0.0f, GLsizei instances = 1) const {
+    bind();
+    current_uniforms().set(mesh_uniforms::lod_fade, fade);
+
+    lod_t r = range(lod);
+    auto offset = (void *)(r.first * sizeof(uint32_t));
+    if (instances == 1) {
+      glDrawElementsBaseVertex(GL_TRIANGLES, r.count, GL_UNSIGNED_INT, offset,
+                               base_vertex);
+    } else {
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, r.count,
+                                        GL_UNSIGNED_INT, offset, instances,
+                                        base_vertex);
+    }
+  }
+
+private:
+  GLuint _vbo = 0;
+  GLuint _ebo = 0;
+  mesh_buffers_t _owned;
+  uint32_t _pending = 0;
+
+  size_t vertex_count() const {
+    return packed() ? _packed.size() : _vertices.size();
+  }
+
+  size_t vertex_bytes() const {
+    return packed() ? _packed.size() * sizeof(packed_vertex_t)
+                    : _vertices.size() * sizeof(vertex_t);
+  }
+
+  size_t vertex_offset() const {
+    return base_vertex *
+           (packed() ? sizeof(packed_vertex_t) : sizeof(vertex_t));
+  }
+
+  size_t index_offset() const { return first_index * sizeof(uint32_t); }
+
+  const void *vertex_data() const {
+    return packed() ? (const void *)_packed.data()
+                    : (const void *)_vertices.data();
+  }
+};
+
+} // namespace cs7gv3::common
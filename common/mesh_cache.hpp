@@ -0,0 +1,347 @@
+#pragma once
+
+#include "importer.hpp"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "simplify.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cs7gv3::common {
+
+// cooked meshes live here, relative to the working directory like the models
+inline std::string mesh_cache_dir = ".cache/mesh";
+
+constexpr uint32_t mesh_cache_magic = 0x434d4746; // "FGMC"
+constexpr uint32_t mesh_cache_version = 6;
+constexpr size_t mesh_cache_align = 16;
+constexpr size_t mesh_cache_max_lods = 8;
+
+struct mesh_cache_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  uint32_t vertex_size;
+  uint32_t n_meshes;
+};
+
+// bytes of the file, texture paths are stored after the geometry
+struct mesh_cache_string_t {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct mesh_cache_entry_t {
+  uint64_t vertex_offset;
+  uint64_t n_vertices;
+  uint64_t index_offset;
+  uint64_t n_indices;
+  mesh_cache_string_t diffuse_map;
+  mesh_cache_string_t normal_map;
+  mesh_cache_string_t specular_map;
+  uint32_t n_lods;
+  lod_t lods[mesh_cache_max_lods];
+  bounds_t bounds;
+};
+
+inline std::string mesh_cache_path(const std::string &source, uint64_t hash) {
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016" PRIx64, hash);
+  return mesh_cache_dir + "/" +
+         std::filesystem::path(source).filename().string() + "-" + hex +
+         ".mesh";
+}
+
+inline bool write_mesh_cache(const std::string &path, uint64_t hash,
+                             const std::vector<mesh_data_t> &meshes) {
+  auto align = [](uint64_t off) {
+    return (off + mesh_cache_align - 1) & ~(uint64_t)(mesh_cache_align - 1);
+  };
+
+  mesh_cache_header_t header{};
+  header.magic = mesh_cache_magic;
+  header.version = mesh_cache_version;
+  header.source_hash = hash;
+  header.vertex_size = sizeof(vertex_t);
+  header.n_meshes = meshes.size();
+
+  std::vector<mesh_cache_entry_t> entries(meshes.size());
+  uint64_t offset =
+      align(sizeof(header) + entries.size() * sizeof(mesh_cache_entry_t));
+  for (size_t i = 0; i < meshes.size(); i++) {
+    mesh_cache_entry_t &e = entries[i];
+    // padding included, bounds_t has initializers hence the cast
+    std::memset(static_cast<void *>(&e), 0, sizeof(e));
+    e.n_vertices = meshes[i].vertices.size();
+    e.n_indices = meshes[i].indices.size();
+    e.vertex_offset = offset;
+    offset = align(offset + e.n_vertices * sizeof(vertex_t));
+    e.index_offset = offset;
+    offset = align(offset + e.n_indices * sizeof(uint32_t));
+
+    e.n_lods = std::min(meshes[i].lods.size(), mesh_cache_max_lods);
+    std::copy_n(meshes[i].lods.begin(), e.n_lods, e.lods);
+    e.bounds = compute_bounds(
+        {meshes[i].vertices.data(), meshes[i].vertices.size()});
+  }
+  // paths last, any length
+  auto place = [&offset](const std::string &path) {
+    mesh_cache_string_t s{offset, path.size()};
+    offset += path.size();
+    return s;
+  };
+  for (size_t i = 0; i < meshes.size(); i++) {
+    const material_ref_t &m = meshes[i].material;
+    entries[i].diffuse_map = place(m.diffuse_map);
+    entries[i].normal_map = place(m.normal_map);
+    entries[i].specular_map = place(m.specular_map);
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+
+  // write next to the target and rename, so a crash never leaves a torn file.
+  // models loading the same source at once each write their own.
+  std::string tmp_path = temp_path(path);
+  FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+  if (!fp) {
+    LOG_ERR("failed to write mesh cache: %s", tmp_path.c_str());
+    return false;
+  }
+
+  auto write_at = [fp](uint64_t off, const void *data, size_t size) {
+    return std::fseek(fp, off, SEEK_SET) == 0 &&
+           std::fwrite(data, 1, size, fp) == size;
+  };
+
+  bool ok = write_at(0, &header, sizeof(header)) &&
+            write_at(sizeof(header), entries.data(),
+                     entries.size() * sizeof(mesh_cache_entry_t));
+  for (size_t i = 0; ok && i < meshes.size(); i++) {
+    ok = write_at(entries[i].vertex_offset, meshes[i].vertices.data(),
+                  meshes[i].vertices.size() * sizeof(vertex_t)) &&
+         write_at(entries[i].index_offset, meshes[i].indices.data(),
+                  meshes[i].indices.size() * sizeof(uint32_t));
+    const material_ref_t &m = meshes[i].material;
+    ok = ok &&
+         write_at(entries[i].diffuse_map.offset, m.diffuse_map.data(),
+                  m.diffuse_map.size()) &&
+         write_at(entries[i].normal_map.offset, m.normal_map.data(),
+                  m.normal_map.size()) &&
+         write_at(entries[i].specular_map.offset, m.specular_map.data(),
+                  m.specular_map.size());
+  }
+  ok = std::fclose(fp) == 0 && ok;
+
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERR("failed to write mesh cache: %s", path.c_str());
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// a cooked mesh file mapped into memory, vertex and index views point
+// straight into the mapping and stay valid as long as the cache lives. when
+// no file could be written, the cooked meshes are held instead.
+class mesh_cache_t {
+public:
+  bool open(const std::string &path, uint64_t hash) {
+    _header = nullptr;
+    _entries = nullptr;
+    _meshes.clear();
+    _bounds.clear();
+    if (!_file.open(path) || _file.size() < sizeof(mesh_cache_header_t)) {
+      return false;
+    }
+
+    auto header = reinterpret_cast<const mesh_cache_header_t *>(_file.data());
+    if (header->magic != mesh_cache_magic ||
+        header->version != mesh_cache_version ||
+        header->source_hash != hash ||
+        header->vertex_size != sizeof(vertex_t) ||
+        _file.size() < sizeof(mesh_cache_header_t) +
+                           header->n_meshes * sizeof(mesh_cache_entry_t)) {
+      _file.close();
+      return false;
+    }
+
+    auto entries = reinterpret_cast<const mesh_cache_entry_t *>(header + 1);
+    auto fits = [this](const mesh_cache_string_t &s) {
+      return s.offset + s.size <= _file.size();
+    };
+    for (size_t i = 0; i < header->n_meshes; i++) {
+      const mesh_cache_entry_t &e = entries[i];
+      if (e.vertex_offset + e.n_vertices * sizeof(vertex_t) > _file.size() ||
+          e.index_offset + e.n_indices * sizeof(uint32_t) > _file.size() ||
+          !fits(e.diffuse_map) || !fits(e.normal_map) ||
+          !fits(e.specular_map) || e.n_lods > mesh_cache_max_lods) {
+        _file.close();
+        return false;
+      }
+      for (uint32_t l = 0; l < e.n_lods; l++) {
+        if ((uint64_t)e.lods[l].first + e.lods[l].count > e.n_indices) {
+          _file.close();
+          return false;
+        }
+      }
+    }
+
+    _header = header;
+    _entries = entries;
+    return true;
+  }
+
+  // serves meshes from memory, the views point into them instead
+  void hold(std::vector<mesh_data_t> meshes) {
+    _file.close();
+    _header = nullptr;
+    _entries = nullptr;
+    _meshes = std::move(meshes);
+    _bounds.clear();
+    for (const mesh_data_t &mesh : _meshes) {
+      _bounds.push_back(
+          compute_bounds({mesh.vertices.data(), mesh.vertices.size()}));
+    }
+  }
+
+  size_t size() const { return _header ? _header->n_meshes : _meshes.size(); }
+
+  array_view_t<vertex_t> vertices(size_t i) const {
+    if (!_header) {
+      return {_meshes[i].vertices.data(), _meshes[i].vertices.size()};
+    }
+    return {reinterpret_cast<const vertex_t *>(_file.data() +
+                                               _entries[i].vertex_offset),
+            _entries[i].n_vertices};
+  }
+
+  array_view_t<uint32_t> indices(size_t i) const {
+    if (!_header) {
+      return {_meshes[i].indices.data(), _meshes[i].indices.size()};
+    }
+    return {reinterpret_cast<const uint32_t *>(_file.data() +
+                                               _entries[i].index_offset),
+            _entries[i].n_indices};
+  }
+
+  material_ref_t material(size_t i) const {
+    if (!_header) {
+      return _meshes[i].material;
+    }
+    const mesh_cache_entry_t &e = _entries[i];
+    return {string(e.diffuse_map), string(e.normal_map),
+            string(e.specular_map)};
+  }
+
+  std::vector<lod_t> lods(size_t i) const {
+    if (!_header) {
+      return _meshes[i].lods;
+    }
+    const mesh_cache_entry_t &e = _entries[i];
+    return std::vector<lod_t>(e.lods, e.lods + e.n_lods);
+  }
+
+  const bounds_t &bounds(size_t i) const {
+    return _header ? _entries[i].bounds : _bounds[i];
+  }
+
+private:
+  mapped_file_t _file;
+  const mesh_cache_header_t *_header = nullptr;
+  const mesh_cache_entry_t *_entries = nullptr;
+  std::vector<mesh_data_t> _meshes;
+  std::vector<bounds_t> _bounds;
+
+  std::string string(const mesh_cache_string_t &s) const {
+    return std::string(reinterpret_cast<const char *>(_file.data()) + s.offset,
+                       s.size);
+  }
+};
+
+// maps the cooked version of a text model, parsing and cooking it first when
+// there is no cache entry for the current content of the source file.
+// false only when the model itself cannot be loaded.
+inline bool load_mesh_cache(const std::string &source, mesh_cache_t &cache) {
+  using clock = std::chrono::steady_clock;
+  auto ms_since = [](clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(clock::now() - t).count();
+  };
+
+  auto start = clock::now();
+  mapped_file_t file(source);
+  if (!file.valid()) {
+    LOG_ERR("failed to open model: %s", source.c_str());
+    return false;
+  }
+  uint64_t hash = hash_bytes(file.data(), file.size());
+  file.close();
+
+  std::string path = mesh_cache_path(source, hash);
+  if (cache.open(path, hash)) {
+    LOG_INFO("mesh cache hit: %s, mapped in %.2f ms", source.c_str(),
+             ms_since(start));
+    return true;
+  }
+
+  std::vector<mesh_data_t> meshes = import_model(source);
+  if (meshes.empty()) {
+    return false;
+  }
+  double import_ms = ms_since(start);
+
+  std::vector<optimize_stats_t> stats(meshes.size());
+  parallel_for(meshes.size(), [&](size_t i) {
+    stats[i] = optimize_mesh(meshes[i]);
+    build_lods(meshes[i]);
+  });
+  optimize_stats_t total;
+  for (const auto &s : stats) {
+    total += s;
+  }
+  LOG_INFO("optimized %s: %zu -> %zu vertices, ACMR %.3f -> %.3f",
+           source.c_str(), total.vertices_before, total.vertices_after,
+           total.acmr_before(), total.acmr_after());
+
+  std::string levels;
+  for (size_t l = 0;; l++) {
+    size_t triangles = 0, n = 0;
+    for (const auto &mesh : meshes) {
+      if (l < mesh.lods.size()) {
+        triangles += mesh.lods[l].count / 3;
+        n++;
+      }
+    }
+    if (n == 0) {
+      break;
+    }
+    levels += (l ? ", " : "") + std::to_string(triangles);
+  }
+  LOG_INFO("LOD triangles %s: %s", source.c_str(), levels.c_str());
+
+  // the cache only saves the next start, a read-only or full disk must not
+  // cost this one its model
+  if (!write_mesh_cache(path, hash, meshes) || !cache.open(path, hash)) {
+    LOG_ERR("mesh cache unavailable, keeping %s in memory", source.c_str());
+    cache.hold(std::move(meshes));
+    return true;
+  }
+
+  LOG_INFO("mesh cache miss: %s, parsed text in %.2f ms, cooked %s in %.2f ms",
+           source.c_str(), import_ms, path.c_str(), ms_since(start));
+  return true;
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,355 @@
+#pragma once
+
+#include "importer.hpp"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// Import time reordering of indexed meshes for the GPU: duplicate vertices
+// are welded, triangles are ordered for the post-transform cache with
+// Tipsify (Sander et al. 2007), clusters of them are sorted front to back
+// from the outside to cut overdraw, and vertices are laid out in first use
+// order for fetch locality.
+namespace cs7gv3::common {
+
+// post-transform cache the triangle order is tuned for, FIFO like most
+// hardware
+constexpr size_t vertex_cache_size = 16;
+
+// how much ACMR the overdraw pass may give up
+constexpr float overdraw_threshold = 1.05f;
+
+struct optimize_stats_t {
+  size_t vertices_before = 0;
+  size_t vertices_after = 0;
+  size_t triangles = 0;
+  size_t misses_before = 0;
+  size_t misses_after = 0;
+
+  // average cache miss ratio, transformed vertices per triangle
+  float acmr_before() const {
+    return triangles ? (float)misses_before / triangles : 0.0f;
+  }
+  float acmr_after() const {
+    return triangles ? (float)misses_after / triangles : 0.0f;
+  }
+
+  optimize_stats_t &operator+=(const optimize_stats_t &o) {
+    vertices_before += o.vertices_before;
+    vertices_after += o.vertices_after;
+    triangles += o.triangles;
+    misses_before += o.misses_before;
+    misses_after += o.misses_after;
+    return *this;
+  }
+};
+
+namespace detail {
+
+class fifo_cache_t {
+public:
+  fifo_cache_t(size_t n_vertices) : _time(n_vertices, 0) {}
+
+  // true on a miss
+  bool touch(uint32_t v) {
+    if (_time[v] != 0 && _clock - _time[v] < vertex_cache_size) {
+      return false;
+    }
+    _time[v] = ++_clock;
+    return true;
+  }
+
+  void reset() {
+    // pushes every vertex out of the window
+    _clock += vertex_cache_size;
+  }
+
+private:
+  std::vector<size_t> _time;
+  size_t _clock = 0;
+};
+
+// triangles using each vertex, CSR layout
+struct adjacency_t {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+
+  adjacency_t(const std::vector<uint32_t> &indices, size_t n_vertices)
+      : offsets(n_vertices + 1, 0), triangles(indices.size()) {
+    for (uint32_t v : indices) {
+      offsets[v + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+      triangles[fill[indices[i]]++] = i / 3;
+    }
+  }
+
+  size_t count(uint32_t v) const { return offsets[v + 1] - offsets[v]; }
+};
+
+} // namespace detail
+
+inline size_t cache_misses(const std::vector<uint32_t> &indices,
+                           size_t n_vertices) {
+  detail::fifo_cache_t cache(n_vertices);
+  size_t misses = 0;
+  for (uint32_t v : indices) {
+    misses += cache.touch(v);
+  }
+  return misses;
+}
+
+// merges vertices whose position, normal and uv are bitwise identical, the
+// importer only shares corners that use the same attribute indices. tangents
+// are per corner until then, so they are recomputed over the welded mesh.
+inline void weld_vertices(mesh_data_t &mesh) {
+  constexpr size_t key_size = offsetof(vertex_t, tangent);
+  auto bytes = [&](uint32_t i) {
+    return reinterpret_cast<const uint8_t *>(&mesh.vertices[i]);
+  };
+  auto hash = [&](uint32_t i) { return hash_bytes(bytes(i), key_size); };
+  auto equal = [&](uint32_t a, uint32_t b) {
+    return std::memcmp(bytes(a), bytes(b), key_size) == 0;
+  };
+  std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)>
+      unique(mesh.vertices.size(), hash, equal);
+
+  std::vector<uint32_t> remap(mesh.vertices.size());
+  std::vector<vertex_t> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (uint32_t i = 0; i < mesh.vertices.size(); i++) {
+    auto [it, inserted] = unique.emplace(i, vertices.size());
+    if (inserted) {
+      vertices.push_back(mesh.vertices[i]);
+    }
+    remap[i] = it->second;
+  }
+  if (vertices.size() == mesh.vertices.size()) {
+    return;
+  }
+
+  for (uint32_t &v : mesh.indices) {
+    v = remap[v];
+  }
+  mesh.vertices = std::move(vertices);
+  compute_tangents(mesh);
+}
+
+// Tipsify, returns the reordered indices. clusters receives the first
+// triangle of every run that starts from a dead end, the points where the
+// order may be cut without hurting the cache much.
+inline std::vector<uint32_t>
+optimize_vertex_cache(const std::vector<uint32_t> &indices, size_t n_vertices,
+                      std::vector<uint32_t> *clusters = nullptr) {
+  const size_t n_triangles = indices.size() / 3;
+  const long k = vertex_cache_size;
+  detail::adjacency_t adjacency(indices, n_vertices);
+
+  std::vector<uint32_t> live(n_vertices);
+  for (uint32_t v = 0; v < n_vertices; v++) {
+    live[v] = adjacency.count(v);
+  }
+  std::vector<long> stamp(n_vertices, 0);
+  std::vector<bool> emitted(n_triangles, false);
+  std::vector<uint32_t> dead_end;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> out;
+  out.reserve(indices.size());
+
+  long time = k + 1;
+  uint32_t cursor = 0;
+  long fan = n_vertices > 0 ? 0 : -1;
+  bool jumped = true;
+
+  while (fan >= 0) {
+    uint32_t first = out.size() / 3;
+    if (jumped && clusters && first < n_triangles &&
+        (clusters->empty() || clusters->back() != first)) {
+      clusters->push_back(first);
+    }
+
+    candidates.clear();
+    for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1];
+         i++) {
+      uint32_t t = adjacency.triangles[i];
+      if (emitted[t]) {
+        continue;
+      }
+      for (int c = 0; c < 3; c++) {
+        uint32_t v = indices[t * 3 + c];
+        out.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - stamp[v] > k) {
+          stamp[v] = time++;
+        }
+      }
+      emitted[t] = true;
+    }
+
+    // the candidate that stays in the cache longest while fanning out
+    fan = -1;
+    long best = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      long priority = 0;
+      if (time - stamp[v] + 2 * (long)live[v] <= k) {
+        priority = time - stamp[v];
+      }
+      if (priority > best) {
+        best = priority;
+        fan = v;
+      }
+    }
+
+    jumped = fan < 0;
+    while (fan < 0 && !dead_end.empty()) {
+      uint32_t v = dead_end.back();
+      dead_end.pop_back();
+      if (live[v] > 0) {
+        fan = v;
+      }
+    }
+    for (; fan < 0 && cursor < n_vertices; cursor++) {
+      if (live[cursor] > 0) {
+        fan = cursor;
+      }
+    }
+  }
+
+  return out;
+}
+
+// sorts cache friendly clusters of triangles so the ones facing away from
+// the centre of the mesh come first, they occlude the rest more often.
+// clusters are the hard boundaries from optimize_vertex_cache(), further
+// split where that costs less than overdraw_threshold in ACMR.
+inline std::vector<uint32_t>
+optimize_overdraw(const std::vector<uint32_t> &indices,
+                  const std::vector<vertex_t> &vertices,
+                  std::vector<uint32_t> clusters) {
+  const size_t n_triangles = indices.size() / 3;
+  if (n_triangles == 0) {
+    return indices;
+  }
+  clusters.push_back(n_triangles);
+
+  std::vector<uint32_t> soft;
+  detail::fifo_cache_t cache(vertices.size());
+  for (size_t c = 0; c + 1 < clusters.size(); c++) {
+    size_t begin = clusters[c], end = clusters[c + 1];
+
+    cache.reset();
+    size_t misses = 0;
+    for (size_t i = begin * 3; i < end * 3; i++) {
+      misses += cache.touch(indices[i]);
+    }
+    float limit = overdraw_threshold * misses / (end - begin);
+
+    cache.reset();
+    soft.push_back(begin);
+    size_t start = begin;
+    misses = 0;
+    for (size_t t = begin; t < end; t++) {
+      for (int i = 0; i < 3; i++) {
+        misses += cache.touch(indices[t * 3 + i]);
+      }
+      if (t + 1 < end && (float)misses / (t + 1 - start) <= limit) {
+        soft.push_back(t + 1);
+        cache.reset();
+        start = t + 1;
+        misses = 0;
+      }
+    }
+  }
+  soft.push_back(n_triangles);
+
+  auto corner = [&](size_t t, int i) {
+    return vertices[indices[t * 3 + i]].position;
+  };
+
+  glm::vec3 mesh_centroid(0.0f);
+  for (uint32_t v : indices) {
+    mesh_centroid += vertices[v].position;
+  }
+  mesh_centroid /= (float)indices.size();
+
+  std::vector<float> key(soft.size() - 1);
+  for (size_t c = 0; c + 1 < soft.size(); c++) {
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t t = soft[c]; t < soft[c + 1]; t++) {
+      glm::vec3 a = corner(t, 0), b = corner(t, 1), d = corner(t, 2);
+      glm::vec3 n = glm::cross(b - a, d - a);
+      float w = glm::length(n);
+      centroid += (a + b + d) * (w / 3.0f);
+      normal += n;
+      area += w;
+    }
+    centroid = area > 0.0f ? centroid / area : corner(soft[c], 0);
+    float len = glm::length(normal);
+    key[c] = len > 0.0f ? glm::dot(centroid - mesh_centroid, normal / len)
+                        : 0.0f;
+  }
+
+  std::vector<uint32_t> order(key.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return key[a] > key[b]; });
+
+  std::vector<uint32_t> out;
+  out.reserve(indices.size());
+  for (uint32_t c : order) {
+    out.insert(out.end(), indices.begin() + soft[c] * 3,
+               indices.begin() + soft[c + 1] * 3);
+  }
+  return out;
+}
+
+// lays vertices out in the order the indices first touch them, unused ones
+// are dropped
+inline void optimize_vertex_fetch(mesh_data_t &mesh) {
+  constexpr uint32_t unused = ~0u;
+  std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+  std::vector<vertex_t> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (uint32_t &v : mesh.indices) {
+    if (remap[v] == unused) {
+      remap[v] = vertices.size();
+      vertices.push_back(mesh.vertices[v]);
+    }
+    v = remap[v];
+  }
+  mesh.vertices = std::move(vertices);
+}
+
+inline optimize_stats_t optimize_mesh(mesh_data_t &mesh) {
+  optimize_stats_t stats;
+  stats.vertices_before = mesh.vertices.size();
+  stats.triangles = mesh.indices.size() / 3;
+  stats.misses_before = cache_misses(mesh.indices, mesh.vertices.size());
+
+  weld_vertices(mesh);
+  std::vector<uint32_t> clusters;
+  mesh.indices =
+      optimize_vertex_cache(mesh.indices, mesh.vertices.size(), &clusters);
+  mesh.indices = optimize_overdraw(mesh.indices, mesh.vertices, clusters);
+  optimize_vertex_fetch(mesh);
+
+  stats.vertices_after = mesh.vertices.size();
+  stats.misses_after = cache_misses(mesh.indices, mesh.vertices.size());
+  return stats;
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,534 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "frustum.hpp"
+#include "importer.hpp"
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "occlusion.hpp"
+#include "packed_vertex.hpp"
+#include "point_index.hpp"
+#include "projection.hpp"
+#include "render_queue.hpp"
+#include "shader.hpp"
+#include "streamer.hpp"
+#include "texture.hpp"
+#include "texture_registry.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cs7gv3::common {
+
+namespace model_uniforms {
+constexpr uniform_t transform = "transform";
+constexpr uniform_t view = "view";
+constexpr uniform_t projection = "projection";
+constexpr uniform_t view_pos = "view_pos";
+constexpr uniform_t mvp = "mvp";
+constexpr uniform_t normal_matrix = "normal_matrix";
+} // namespace model_uniforms
+
+// object_t that loads its geometry from the cooked mesh cache instead of
+// parsing the text model on every launch. object_t::init() is deliberately
+// not called, it would import the text file again.
+class model_t : public figine::core::object_t, public renderable_if {
+public:
+  model_t(const std::string &path, figine::core::camera_t *camera,
+          bool gamma_correction = false)
+      : figine::core::object_t(path, camera, gamma_correction), _path(path),
+        _gamma_correction(gamma_correction) {}
+
+  // shadows object_t::_meshes, which stays empty
+  std::vector<mesh_t> _meshes;
+
+  // upload packed_vertex_t instead of vertex_t, set before init(). the
+  // shader has to decode them, see CS7GV3_PACKED_VERTEX_GLSL.
+  bool packed_vertices = false;
+
+  // geometric error in pixels a LOD may show before a finer one is drawn
+  float lod_error_pixels = 1.0f;
+  // dither between LODs for lod_fade_seconds instead of popping, the
+  // fragment shader needs CS7GV3_LOD_FADE_GLSL
+  bool lod_cross_fade = false;
+  float lod_fade_seconds = 0.25f;
+
+  // the pass submit() puts the meshes in
+  render_pass_t pass = render_pass_t::opaque;
+  // skip meshes outside the view frustum in loop() and submit()
+  bool frustum_culling = true;
+  // also skip those hidden in the last captured depth, when set
+  occlusion_t *occlusion = nullptr;
+  // suballocate the meshes from geometry_pool() so those sharing textures
+  // draw in one call, set before init()
+  bool pooled_geometry = true;
+  // index each mesh's vertices for nearest_vertex() and vertices_within(),
+  // set before init()
+  bool point_queries = false;
+
+  // only schedules the load, the meshes show up once streamer::update()
+  // has made them resident and draw with placeholder textures until theirs
+  // arrive.
+  void init() override {
+    streamer::async([this]() -> std::function<void()> {
+      if (!load_mesh_cache(_path, _cache)) {
+        LOG_ERR("failed to load model: %s", _path.c_str());
+        return nullptr;
+      }
+      if (packed_vertices) {
+        pack();
+      }
+      if (point_queries) {
+        index_points();
+      }
+      return [this]() { stream(); };
+    });
+  }
+
+  // sets what object_t would, itself for a shader_t whose program figine
+  // cannot see, plus mvp and normal_matrix so vertex shaders no longer
+  // multiply or invert matrices per vertex
+  void apply_uniform(const figine::core::shader_if &shader) override {
+    namespace u = model_uniforms;
+    glm::mat4 view = camera->view_matrix();
+    glm::mat4 projection = projection_matrix();
+
+    const shader_t *own = shader_t::from(shader);
+    if (own) {
+      own->bind();
+    } else {
+      // figine calls glUseProgram itself, and what else it binds is not
+      // ours to see, so the shadow cannot be trusted after it
+      figine::core::object_t::apply_uniform(shader);
+      gl_state.invalidate();
+    }
+
+    const uniform_table_t &uniforms = current_uniforms();
+    if (own) {
+      uniforms.set(u::transform, transform);
+      uniforms.set(u::view, view);
+      uniforms.set(u::projection, projection);
+      uniforms.set(u::view_pos, camera->position);
+    }
+    update_matrices(projection * view);
+    uniforms.set(u::mvp, _mvp);
+    uniforms.set(u::normal_matrix, _normal_matrix);
+  }
+
+  // as of the last apply_uniform()
+  const glm::mat4 &mvp() const { return _mvp; }
+  const glm::mat3 &normal_matrix() const { return _normal_matrix; }
+
+  // draws right away, a batch at a time
+  void loop(const figine::core::shader_if &shader) {
+    update();
+    cull(frustum_t(projection_matrix() * camera->view_matrix()));
+    batch();
+
+    for (size_t i = 0; i < _batches.size(); i++) {
+      draw_item(&shader, i);
+    }
+  }
+
+  // one packet per batch of visible meshes, keyed on the program, the first
+  // texture and the distance to the nearest mesh. updates the object, once
+  // per frame.
+  void submit(render_queue_t &queue, const shader_t &shader) {
+    update();
+    cull(frustum_t(projection_matrix() * camera->view_matrix()));
+    batch();
+
+    for (size_t i = 0; i < _batches.size(); i++) {
+      const batch_t &batch = _batches[i];
+      const mesh_t &first = _meshes[_batch_meshes[batch.first]];
+      uint32_t material =
+          first.textures.empty() ? 0 : first.textures[0].texture->bind_id();
+      float depth = INFINITY;
+      for (uint32_t j = batch.first; j < batch.first + batch.count; j++) {
+        const mesh_t &mesh = _meshes[_batch_meshes[j]];
+        glm::vec3 center = transform * glm::vec4(mesh.bounds.center(), 1.0f);
+        depth = std::min(depth, glm::distance(camera->position, center));
+      }
+      queue.submit(render_key(pass, shader.program(), material, depth), this,
+                   &shader, i);
+    }
+  }
+
+  // packets of one object may be split by others, so each sets the
+  // object's uniforms again. the shadows drop what did not change.
+  void draw_item(const figine::core::shader_if *shader,
+                 uint32_t item) override {
+    const batch_t &batch = _batches[item];
+    if (batch.count > 1) {
+      apply_uniform(*shader);
+      draw_batch(batch);
+      return;
+    }
+
+    size_t i = _batch_meshes[batch.first];
+    bool queried = _mesh_visible[i] == mesh_queried;
+    if (queried) {
+      occlusion->begin_conditional(
+          _meshes[i].bounds.transformed(transform),
+          projection_matrix() * camera->view_matrix());
+    }
+    apply_uniform(*shader);
+    draw_mesh(*shader, i);
+    if (queried) {
+      occlusion->end_conditional();
+    }
+  }
+
+  // decides which resident meshes the frame draws and counts them in
+  // cull_stats and occlusion_stats
+  virtual void cull(const frustum_t &frustum) {
+    _mesh_visible.assign(_meshes.size(), mesh_hidden);
+    for (size_t i = 0; i < _meshes.size(); i++) {
+      if (!_meshes[i].resident()) {
+        continue;
+      }
+      bounds_t world = _meshes[i].bounds.transformed(transform);
+      if (frustum_culling && !frustum.visible(world)) {
+        cull_stats.culled++;
+        continue;
+      }
+
+      _mesh_visible[i] = mesh_shown;
+      if (occlusion) {
+        occlusion_stats.tested++;
+        switch (occlusion->test(world)) {
+        case occlusion_t::result_t::occluded:
+          occlusion_stats.occluded++;
+          _mesh_visible[i] = mesh_hidden;
+          break;
+        case occlusion_t::result_t::uncertain:
+          occlusion_stats.conditional++;
+          _mesh_visible[i] = mesh_queried;
+          break;
+        default:
+          break;
+        }
+      }
+      (_mesh_visible[i] ? cull_stats.visible : cull_stats.culled)++;
+    }
+  }
+
+  // mesh i at the LOD its distance calls for, the object's uniforms set.
+  // only meshes drawn alone come through here, a batch of several goes
+  // straight to glMultiDrawElementsBaseVertex. state every mesh needs
+  // belongs in apply_uniform(), which runs before either.
+  virtual void draw_mesh(const figine::core::shader_if &shader, size_t i) {
+    const mesh_t &mesh = _meshes[i];
+    size_t lod = select_lod(mesh);
+    if (!lod_cross_fade) {
+      mesh.draw(lod);
+      return;
+    }
+
+    lod_state_t &state = _lod_state[i];
+    float t = fade_to(state, lod, glfwGetTime());
+    if (t >= 1.0f) {
+      mesh.draw(state.current);
+      return;
+    }
+    // a fade of 0 means every pixel, a level without any share is skipped
+    if (t > 0.0f) {
+      mesh.draw(state.current, t);
+    }
+    mesh.draw(state.previous, t - 1.0f);
+  }
+
+  // the coarsest level whose error projects to at most lod_error_pixels at
+  // the nearest view depth of the mesh's bounding sphere. the projection
+  // divides by depth, not by distance, which is larger off the view axis.
+  size_t select_lod(const mesh_t &mesh) const {
+    return select_lod(mesh, transform);
+  }
+
+  // the same for the mesh placed by world instead of the object's transform
+  size_t select_lod(const mesh_t &mesh, const glm::mat4 &world) const {
+    if (mesh.lods.size() < 2) {
+      return 0;
+    }
+
+    glm::mat3 m(world);
+    float scale = std::max(
+        {glm::length(m[0]), glm::length(m[1]), glm::length(m[2])});
+    glm::vec4 center = camera->view_matrix() * world *
+                       glm::vec4(mesh.bounds.center(), 1.0f);
+    float distance =
+        std::max(-center.z - mesh.bounds.radius * scale, near_plane);
+    float pixels_per_unit =
+        figine::global::win_mgr::height /
+        (2.0f * distance * std::tan(glm::radians(camera->zoom) * 0.5f));
+
+    for (size_t lod = mesh.lods.size() - 1; lod > 0; lod--) {
+      if (mesh.lods[lod].error * scale * pixels_per_unit <= lod_error_pixels) {
+        return lod;
+      }
+    }
+    return 0;
+  }
+
+  // model space, all meshes together. empty until the meshes are streamed.
+  const bounds_t &bounds() const { return _bounds; }
+
+  glm::mat4 projection_matrix() const {
+    return common::projection_matrix(*camera);
+  }
+
+  // a vertex of _meshes[mesh]._vertices, distance in model space
+  struct vertex_hit_t {
+    uint32_t mesh;
+    uint32_t vertex;
+    float distance;
+  };
+
+  // the vertex closest to a model space point over every mesh. false until
+  // the meshes are streamed or without point_queries.
+  bool nearest_vertex(const glm::vec3 &p, vertex_hit_t &hit) const {
+    if (!point_queries) {
+      return false;
+    }
+
+    bool found = false;
+    hit.distance = INFINITY;
+    for (size_t i = 0; i < _meshes.size(); i++) {
+      // no vertex is closer than the mesh's box
+      const bounds_t &b = _meshes[i].bounds;
+      if (glm::distance(p, glm::clamp(p, b.min, b.max)) >= hit.distance) {
+        continue;
+      }
+      point_index_t::hit_t h;
+      if (_point_index[i].nearest(p, h, hit.distance)) {
+        hit = {(uint32_t)i, h.index, h.distance};
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  // appends every vertex within radius of a model space point
+  void vertices_within(const glm::vec3 &p, float radius,
+                       std::vector<vertex_hit_t> &hits) const {
+    if (!point_queries) {
+      return;
+    }
+
+    std::vector<point_index_t::hit_t> mesh_hits;
+    for (size_t i = 0; i < _meshes.size(); i++) {
+      const bounds_t &b = _meshes[i].bounds;
+      if (glm::distance(p, glm::clamp(p, b.min, b.max)) > radius) {
+        continue;
+      }
+      mesh_hits.clear();
+      _point_index[i].within(p, radius, mesh_hits);
+      for (const point_index_t::hit_t &h : mesh_hits) {
+        hits.push_back({(uint32_t)i, h.index, h.distance});
+      }
+    }
+  }
+
+  bool resident() const {
+    return !_meshes.empty() &&
+           std::all_of(_meshes.begin(), _meshes.end(),
+                       [](const mesh_t &mesh) { return mesh.resident(); });
+  }
+
+protected:
+  std::string _path;
+  bool _gamma_correction;
+  mesh_cache_t _cache;
+  std::vector<quantization_t> _quantization;
+  std::vector<std::vector<packed_vertex_t>> _packed;
+  // a tree per mesh, built with the cache and complete before _meshes fills
+  std::vector<point_index_t> _point_index;
+
+  struct lod_state_t {
+    size_t current = 0;
+    size_t previous = 0;
+    double since = 0.0;
+  };
+  std::vector<lod_state_t> _lod_state;
+
+  // moves state on to lod, returns how far the fade in of the current level
+  // has got, 1 once it is complete
+  float fade_to(lod_state_t &state, size_t lod, double now) const {
+    if (lod != state.current) {
+      state.previous = state.current;
+      state.current = lod;
+      state.since = now;
+    }
+    if (state.previous == state.current) {
+      return 1.0f;
+    }
+    return std::min((float)((now - state.since) / lod_fade_seconds), 1.0f);
+  }
+
+  // of the last cull(), queried draws conditionally on an occlusion query
+  static constexpr uint8_t mesh_hidden = 0;
+  static constexpr uint8_t mesh_shown = 1;
+  static constexpr uint8_t mesh_queried = 2;
+  std::vector<uint8_t> _mesh_visible;
+  bounds_t _bounds;
+
+  // of the last batch(), a run of _batch_meshes drawn in one call
+  struct batch_t {
+    uint32_t first;
+    uint32_t count;
+  };
+  std::vector<batch_t> _batches;
+  std::vector<uint32_t> _batch_meshes;
+
+private:
+  // arguments of glMultiDrawElementsBaseVertex, kept to reuse the storage
+  std::vector<GLsizei> _draw_counts;
+  std::vector<const void *> _draw_offsets;
+  std::vector<GLint> _draw_base_vertices;
+
+  // a mesh drawn under a query, cross-fading or in buffers of its own draws
+  // alone through draw_mesh()
+  bool batchable(size_t i) const {
+    return _meshes[i].pooled && !lod_cross_fade &&
+           _mesh_visible[i] == mesh_shown;
+  }
+
+  // groups the visible meshes into batches of meshes that shares_state(),
+  // sorted so those sharing a vertex array and a texture sit side by side
+  void batch() {
+    _batch_meshes.clear();
+    _batches.clear();
+    for (size_t i = 0; i < _meshes.size(); i++) {
+      if (_mesh_visible[i]) {
+        _batch_meshes.push_back(i);
+      }
+    }
+
+    auto state = [this](uint32_t i) {
+      const mesh_t &mesh = _meshes[i];
+      GLuint texture =
+          mesh.textures.empty() ? 0 : mesh.textures[0].texture->bind_id();
+      return std::make_pair(mesh.vao, texture);
+    };
+    std::stable_sort(
+        _batch_meshes.begin(), _batch_meshes.end(),
+        [&](uint32_t a, uint32_t b) { return state(a) < state(b); });
+
+    for (uint32_t j = 0; j < _batch_meshes.size(); j++) {
+      uint32_t i = _batch_meshes[j];
+      if (!_batches.empty()) {
+        batch_t &last = _batches.back();
+        uint32_t first = _batch_meshes[last.first];
+        if (batchable(i) && batchable(first) &&
+            _meshes[first].shares_state(_meshes[i])) {
+          last.count++;
+          continue;
+        }
+      }
+      _batches.push_back({j, 1});
+    }
+  }
+
+  // every mesh of the batch at its own LOD, in one draw call
+  void draw_batch(const batch_t &batch) {
+    _draw_counts.clear();
+    _draw_offsets.clear();
+    _draw_base_vertices.clear();
+    for (uint32_t j = batch.first; j < batch.first + batch.count; j++) {
+      const mesh_t &mesh = _meshes[_batch_meshes[j]];
+      lod_t range = mesh.range(select_lod(mesh));
+      _draw_counts.push_back(range.count);
+      _draw_offsets.push_back((void *)(range.first * sizeof(uint32_t)));
+      _draw_base_vertices.push_back(mesh.base_vertex);
+    }
+
+    _meshes[_batch_meshes[batch.first]].bind();
+    current_uniforms().set(mesh_uniforms::lod_fade, 0.0f);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, _draw_counts.data(),
+                                  GL_UNSIGNED_INT, _draw_offsets.data(),
+                                  batch.count, _draw_base_vertices.data());
+  }
+
+  // inputs of the last update_matrices(), transform is a public member of
+  // object_t so a change only shows up by comparing
+  glm::mat4 _matrices_transform = glm::mat4(0.0f);
+  glm::mat4 _matrices_view_projection = glm::mat4(0.0f);
+  glm::mat4 _mvp = glm::mat4(1.0f);
+  glm::mat3 _normal_matrix = glm::mat3(1.0f);
+
+  void update_matrices(const glm::mat4 &view_projection) {
+    if (transform != _matrices_transform) {
+      _normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    } else if (view_projection == _matrices_view_projection) {
+      return;
+    }
+    _mvp = view_projection * transform;
+    _matrices_transform = transform;
+    _matrices_view_projection = view_projection;
+  }
+
+  void pack() {
+    _quantization.resize(_cache.size());
+    _packed.resize(_cache.size());
+    parallel_for(_cache.size(), [this](size_t i) {
+      _quantization[i] = position_quantization(_cache.vertices(i));
+      _packed[i] = pack_vertices(_cache.vertices(i), _quantization[i]);
+    });
+  }
+
+  void index_points() {
+    _point_index.resize(_cache.size());
+    parallel_for(_cache.size(), [this](size_t i) {
+      _point_index[i] = point_index_t(_cache.vertices(i));
+    });
+  }
+
+  void stream() {
+    std::string dir = detail::directory_of(_path);
+    _meshes.resize(_cache.size());
+    _lod_state.resize(_cache.size());
+    for (size_t i = 0; i < _cache.size(); i++) {
+      mesh_t &mesh = _meshes[i];
+      mesh._vertices = _cache.vertices(i);
+      mesh._indices = _cache.indices(i);
+      mesh.lods = _cache.lods(i);
+      mesh.bounds = _cache.bounds(i);
+      _bounds = i == 0 ? mesh.bounds : merge_bounds(_bounds, mesh.bounds);
+      if (!_packed.empty()) {
+        mesh._packed = {_packed[i].data(), _packed[i].size()};
+        mesh.quantization = _quantization[i];
+      }
+      mesh.pooled = pooled_geometry;
+      mesh.stream();
+
+      material_ref_t material = _cache.material(i);
+      add_texture(mesh, dir, material.diffuse_map, "texture_diffuse");
+      add_texture(mesh, dir, material.specular_map, "texture_specular");
+      add_texture(mesh, dir, material.normal_map, "texture_normal");
+    }
+  }
+
+  void add_texture(mesh_t &mesh, const std::string &dir,
+                   const std::string &file, const std::string &type) {
+    if (file.empty()) {
+      return;
+    }
+
+    // colour maps are the only ones stored in sRGB
+    sampler_t sampler;
+    sampler.srgb = _gamma_correction && type == "texture_diffuse";
+    // BC1 smears normals, keep them exact
+    sampler.compress = type != "texture_normal";
+    mesh.textures.push_back(
+        {texture_registry::load_2d(dir + file, sampler,
+                                   placeholder_texture(type)),
+         type, uniform_t(type)});
+  }
+};
+
+} // namespace cs7gv3::common
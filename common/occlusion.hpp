@@ -0,0 +1,480 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+#include "uniform.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// Occlusion culling against the previous frame. After the opaque pass
+// capture() copies the depth buffer and reduces it into a pyramid whose
+// texels keep the farthest depth below them, then reads one small level back
+// through a pixel buffer. The copy lands a frame or two later and test()
+// checks bounds against it on the CPU, with the view-projection it was
+// captured with, so nothing ever waits on the GPU.
+//
+// bounds close to the stored depth are too close to call with stale data.
+// begin_conditional() draws their box into a GL_ANY_SAMPLES_PASSED query
+// and renders the real draw conditionally on it, the GPU decides.
+//
+//   occlusion.begin_frame();
+//   render_queue.execute();
+//   occlusion.capture(view_projection);
+namespace cs7gv3::common {
+
+// counted by the draw paths, GPU times of the frame the queries came back
+// for. the saved time is the scene time spread evenly over what was drawn.
+struct occlusion_stats_t {
+  size_t tested = 0;
+  size_t occluded = 0;
+  size_t conditional = 0;
+  size_t last_tested = 0;
+  size_t last_occluded = 0;
+  size_t last_conditional = 0;
+  double scene_ms = 0.0;
+  double hiz_ms = 0.0;
+
+  void end_frame() {
+    last_tested = tested;
+    last_occluded = occluded;
+    last_conditional = conditional;
+    tested = occluded = conditional = 0;
+  }
+
+  double saved_ms(size_t drawn) const {
+    return drawn ? scene_ms * last_occluded / drawn : 0.0;
+  }
+};
+
+inline occlusion_stats_t occlusion_stats;
+
+constexpr uint8_t hiz_vs[] = R"(
+#version 330 core
+
+// one triangle covering the target, no vertex buffer
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// the base level of source is the one read, the level written is excluded
+// from sampling so there is no feedback loop
+constexpr uint8_t hiz_fs[] = R"(
+#version 330 core
+
+uniform sampler2D source;
+
+out float max_depth;
+
+void main() {
+  ivec2 size = textureSize(source, 0);
+  ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+  // an odd size leaves a row or column over, the last texel takes it in
+  ivec2 end = min(p + 1 + ivec2(equal(p + 3, size)), size - 1);
+
+  float d = 0.0;
+  for (int y = p.y; y <= end.y; y++) {
+    for (int x = p.x; x <= end.x; x++) {
+      d = max(d, texelFetch(source, ivec2(x, y), 0).r);
+    }
+  }
+  max_depth = d;
+}
+)";
+
+constexpr uint8_t proxy_vs[] = R"(
+#version 330 core
+
+layout(location = 0) in vec3 pos_in;
+
+uniform mat4 mvp;
+
+void main() {
+  gl_Position = mvp * vec4(pos_in, 1.0);
+}
+)";
+
+constexpr uint8_t proxy_fs[] = R"(
+#version 330 core
+
+void main() {}
+)";
+
+namespace occlusion_uniforms {
+constexpr uniform_t source = "source";
+constexpr uniform_t mvp = "mvp";
+} // namespace occlusion_uniforms
+
+// GL thread only, init() after the context exists. test() only reads the
+// last copy and may run on any thread while nothing captures.
+class occlusion_t {
+public:
+  enum class result_t { visible, occluded, uncertain };
+
+  // the level read back is the first at most this wide
+  int readback_width = 64;
+  // window-space depth within this of the stored one is uncertain
+  float margin = 0.0005f;
+
+  occlusion_t() = default;
+
+  ~occlusion_t() {
+    // assignment1 keeps one as an inline global, past the context
+    if (glfwGetCurrentContext()) {
+      release();
+    }
+  }
+
+  occlusion_t(const occlusion_t &) = delete;
+  occlusion_t &operator=(const occlusion_t &) = delete;
+
+  void init() {
+    glGenVertexArrays(1, &_vao);
+    glGenFramebuffers(1, &_fbo);
+    glGenBuffers(1, &_pbo);
+    glGenQueries(n_frames * 2, &_timers[0][0]);
+
+    // the unit cube the proxies scale into place
+    static const float vertices[] = {
+        -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,
+        -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, 1.0f,  1.0f,
+        -1.0f, 1.0f,  1.0f,  1.0f,  1.0f,  -1.0f, 1.0f,  1.0f,
+    };
+    static const uint8_t indices[] = {
+        0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4, 0, 3, 7, 7, 4, 0,
+        1, 5, 6, 6, 2, 1, 3, 2, 6, 6, 7, 3, 0, 1, 5, 5, 4, 0,
+    };
+    glGenVertexArrays(1, &_cube);
+    glGenBuffers(2, _cube_buffers);
+    gl_state.bind_vertex_array(_cube);
+    defer(gl_state.bind_vertex_array(0));
+    gl_state.bind_array_buffer(_cube_buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _cube_buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+                 GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), NULL);
+  }
+
+  // times the scene and picks up timings that came back meanwhile
+  void begin_frame() {
+    if (!_vao) {
+      return;
+    }
+    _next_query = 0;
+    _frame = (_frame + 1) % n_frames;
+    if (_timed[_frame]) {
+      read_timers(_frame);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, _timers[_frame][0]);
+    _timed[_frame] = 1;
+  }
+
+  // after the opaque pass, with the view-projection it was drawn with. does
+  // nothing but close the scene timer while the last copy is still on its
+  // way.
+  void capture(const glm::mat4 &view_projection) {
+    if (!_vao) {
+      return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    poll();
+    if (_fence) {
+      return;
+    }
+
+    GLint viewport[4] = {0, 0, 1, 1};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] != _width || viewport[3] != _height) {
+      resize(viewport[2], viewport[3]);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, _timers[_frame][1]);
+    _timed[_frame] = 2;
+
+    // the read framebuffer is whatever the scene went to
+    gl_state.bind_texture(0, GL_TEXTURE_2D, _depth);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1],
+                        _width, _height);
+    reduce(viewport);
+
+    gl_state.bind_texture(0, GL_TEXTURE_2D, _hiz);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glGetTexImage(GL_TEXTURE_2D, _readback_level, GL_RED, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pending_view_projection = view_projection;
+
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+
+  // window-space bounds of the box against the farthest stored depth under
+  // it. anything crossing the near plane of the stored view is visible.
+  result_t test(const bounds_t &world) const {
+    if (_cpu.empty()) {
+      return result_t::visible;
+    }
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (int i = 0; i < 8; i++) {
+      glm::vec3 corner(i & 1 ? world.max.x : world.min.x,
+                       i & 2 ? world.max.y : world.min.y,
+                       i & 4 ? world.max.z : world.min.z);
+      glm::vec4 clip = _view_projection * glm::vec4(corner, 1.0f);
+      if (clip.w <= 1e-5f) {
+        return result_t::visible;
+      }
+      glm::vec3 window = glm::vec3(clip) / clip.w * 0.5f + 0.5f;
+      lo = glm::min(lo, window);
+      hi = glm::max(hi, window);
+    }
+    if (lo.z <= 0.0f) {
+      return result_t::visible;
+    }
+
+    int x0 = std::clamp((int)(lo.x * _cpu_width), 0, _cpu_width - 1);
+    int x1 = std::clamp((int)(hi.x * _cpu_width), 0, _cpu_width - 1);
+    int y0 = std::clamp((int)(lo.y * _cpu_height), 0, _cpu_height - 1);
+    int y1 = std::clamp((int)(hi.y * _cpu_height), 0, _cpu_height - 1);
+    float farthest = 0.0f;
+    for (int y = y0; y <= y1; y++) {
+      for (int x = x0; x <= x1; x++) {
+        farthest = std::max(farthest, _cpu[y * _cpu_width + x]);
+      }
+    }
+
+    if (lo.z > farthest + margin) {
+      return result_t::occluded;
+    }
+    return lo.z > farthest - margin ? result_t::uncertain : result_t::visible;
+  }
+
+  // draws the box into a fresh query without touching colour or depth and
+  // starts rendering conditionally on it. the program in use changes, set
+  // the object's uniforms after this.
+  void begin_conditional(const bounds_t &world,
+                         const glm::mat4 &view_projection) {
+    if (_next_query == _queries.size()) {
+      _queries.push_back(0);
+      glGenQueries(1, &_queries.back());
+    }
+    GLuint query = _queries[_next_query++];
+
+    _proxy.bind();
+    glm::mat4 box = glm::translate(glm::mat4(1.0f), world.center()) *
+                    glm::scale(glm::mat4(1.0f), world.extent());
+    current_uniforms().set(occlusion_uniforms::mvp, view_projection * box);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    gl_state.depth_mask(false);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+    gl_state.bind_vertex_array(_cube);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    gl_state.depth_mask(true);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    glBeginConditionalRender(query, GL_QUERY_BY_REGION_WAIT);
+  }
+
+  void end_conditional() { glEndConditionalRender(); }
+
+private:
+  static constexpr int n_frames = 4;
+
+  shader_t _reduce{hiz_vs, hiz_fs};
+  shader_t _proxy{proxy_vs, proxy_fs};
+  GLuint _vao = 0;
+  GLuint _fbo = 0;
+  GLuint _pbo = 0;
+  GLuint _cube = 0;
+  GLuint _cube_buffers[2] = {};
+  GLuint _depth = 0;
+  GLuint _hiz = 0;
+  GLint _width = 0;
+  GLint _height = 0;
+  // size of every pyramid level, level 0 is half the depth buffer
+  std::vector<glm::ivec2> _levels;
+  GLint _readback_level = 0;
+  GLsync _fence = 0;
+  glm::mat4 _pending_view_projection = glm::mat4(1.0f);
+
+  // the copy test() reads
+  std::vector<float> _cpu;
+  int _cpu_width = 0;
+  int _cpu_height = 0;
+  glm::mat4 _view_projection = glm::mat4(1.0f);
+
+  std::vector<GLuint> _queries;
+  size_t _next_query = 0;
+
+  // scene and pyramid timers per frame in flight, _timed says how many of
+  // a frame's were started
+  GLuint _timers[n_frames][2] = {};
+  int _timed[n_frames] = {};
+  int _frame = 0;
+
+  void read_timers(int frame) {
+    GLint available = 0;
+    glGetQueryObjectiv(_timers[frame][_timed[frame] - 1],
+                       GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      return;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(_timers[frame][0], GL_QUERY_RESULT, &ns);
+    occlusion_stats.scene_ms = ns / 1e6;
+    if (_timed[frame] > 1) {
+      glGetQueryObjectui64v(_timers[frame][1], GL_QUERY_RESULT, &ns);
+      occlusion_stats.hiz_ms = ns / 1e6;
+    }
+  }
+
+  // takes the copy once the GPU is done with it
+  void poll() {
+    if (!_fence) {
+      return;
+    }
+    GLenum status = glClientWaitSync(_fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      return;
+    }
+    glDeleteSync(_fence);
+    _fence = 0;
+
+    glm::ivec2 size = _levels[_readback_level];
+    _cpu.resize(size.x * size.y);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                        _cpu.size() * sizeof(float),
+                                        GL_MAP_READ_BIT);
+    if (data) {
+      std::memcpy(_cpu.data(), data, _cpu.size() * sizeof(float));
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      _cpu_width = size.x;
+      _cpu_height = size.y;
+      _view_projection = _pending_view_projection;
+    } else {
+      _cpu.clear();
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  // each level from the one before, the first from the depth copy
+  void reduce(const GLint viewport[4]) {
+    GLint target = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _fbo);
+    gl_state.enable(GL_DEPTH_TEST, false);
+
+    _reduce.bind();
+    current_uniforms().set(occlusion_uniforms::source, 0);
+    gl_state.bind_vertex_array(_vao);
+    for (size_t level = 0; level < _levels.size(); level++) {
+      if (level == 0) {
+        gl_state.bind_texture(0, GL_TEXTURE_2D, _depth);
+      } else {
+        gl_state.bind_texture(0, GL_TEXTURE_2D, _hiz);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+      }
+      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, _hiz, level);
+      glViewport(0, 0, _levels[level].x, _levels[level].y);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    gl_state.bind_texture(0, GL_TEXTURE_2D, _hiz);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                    _levels.size() - 1);
+
+    // the scene draws with it on
+    gl_state.enable(GL_DEPTH_TEST, true);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+
+  void resize(GLint width, GLint height) {
+    release_textures();
+    _width = width;
+    _height = height;
+
+    glGenTextures(1, &_depth);
+    gl_state.bind_texture(0, GL_TEXTURE_2D, _depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    _levels.clear();
+    glm::ivec2 size(width, height);
+    do {
+      size = glm::max(size / 2, glm::ivec2(1));
+      _levels.push_back(size);
+    } while (size.x > 1 || size.y > 1);
+
+    _readback_level = _levels.size() - 1;
+    for (size_t level = 0; level < _levels.size(); level++) {
+      if (_levels[level].x <= readback_width) {
+        _readback_level = level;
+        break;
+      }
+    }
+
+    glGenTextures(1, &_hiz);
+    gl_state.bind_texture(0, GL_TEXTURE_2D, _hiz);
+    for (size_t level = 0; level < _levels.size(); level++) {
+      glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, _levels[level].x,
+                   _levels[level].y, 0, GL_RED, GL_FLOAT, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glm::ivec2 readback = _levels[_readback_level];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, readback.x * readback.y * sizeof(float),
+                 nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // the copy in hand was taken at another size
+    _cpu.clear();
+  }
+
+  void release_textures() {
+    if (_depth) {
+      gl_state.delete_textures(1, &_depth);
+      gl_state.delete_textures(1, &_hiz);
+      _depth = _hiz = 0;
+    }
+  }
+
+  void release() {
+    release_textures();
+    if (_vao) {
+      if (_fence) {
+        glDeleteSync(_fence);
+      }
+      gl_state.delete_vertex_arrays(1, &_vao);
+      gl_state.delete_vertex_arrays(1, &_cube);
+      glDeleteFramebuffers(1, &_fbo);
+      gl_state.delete_buffers(1, &_pbo);
+      gl_state.delete_buffers(2, _cube_buffers);
+      glDeleteQueries(n_frames * 2, &_timers[0][0]);
+      glDeleteQueries(_queries.size(), _queries.data());
+      _vao = 0;
+    }
+  }
+};
+
+} // namespace cs7gv3::common
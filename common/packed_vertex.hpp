@@ -0,0 +1,127 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cs7gv3::common {
+
+// 20 byte alternative to vertex_t, same attribute locations:
+//   0: position, unorm16 relative to the mesh AABB
+//   1: normal, snorm 10:10:10:2
+//   2: texture coordinate, half floats
+//   3: tangent, snorm 10:10:10:2, w holds the bitangent sign
+//   4: not fed, the bitangent is rebuilt in the shader
+struct packed_vertex_t {
+  uint16_t position[4]; // w is padding
+  uint16_t texture_coordinate[2];
+  uint32_t normal;
+  uint32_t tangent;
+};
+
+static_assert(sizeof(packed_vertex_t) == 20,
+              "packed_vertex_t must stay tightly packed");
+
+// maps unorm positions back into model space, position = offset + p * scale
+struct quantization_t {
+  glm::vec3 offset = glm::vec3(0.0f);
+  glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// splice into a vertex shader after #version to read either vertex format.
+// mesh_t::draw() sets the uniforms, identity for plain vertex_t meshes, and
+// leaves the bitangent attribute zero for packed ones. only the sign of the
+// 2 bit w is used, GL 4.1 reads -1 back as -1/3.
+#define CS7GV3_PACKED_VERTEX_GLSL                                              \
+  "uniform vec3 position_offset;\n"                                            \
+  "uniform vec3 position_scale;\n"                                             \
+  "vec3 decode_position(vec3 p) {\n"                                           \
+  "  return position_offset + p * position_scale;\n"                           \
+  "}\n"                                                                        \
+  "vec3 decode_bitangent(vec3 n, vec4 t, vec3 b) {\n"                          \
+  "  return dot(b, b) > 0.0 ? b : cross(n, t.xyz) * sign(t.w);\n"              \
+  "}\n"
+
+namespace detail {
+
+inline uint16_t float_to_half(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, 4);
+  uint32_t sign = (x >> 16) & 0x8000;
+  int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = x & 0x7fffff;
+
+  if (exponent >= 31) {
+    // overflow and inf, nan is never a texture coordinate
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    return sign | ((mantissa + (1u << (shift - 1))) >> shift);
+  }
+  // round to nearest, a carry into the exponent is still the right value
+  return sign | (((uint32_t)exponent << 10) + ((mantissa + 0x1000) >> 13));
+}
+
+inline uint32_t pack_snorm10(float v) {
+  int q = (int)std::lround(std::clamp(v, -1.0f, 1.0f) * 511.0f);
+  return (uint32_t)q & 0x3ff;
+}
+
+// GL_INT_2_10_10_10_REV, x in the low bits
+inline uint32_t pack_1010102(const glm::vec3 &v, float w) {
+  uint32_t sw = w < 0.0f ? 3 : 1;
+  return pack_snorm10(v.x) | (pack_snorm10(v.y) << 10) |
+         (pack_snorm10(v.z) << 20) | (sw << 30);
+}
+
+} // namespace detail
+
+inline quantization_t position_quantization(array_view_t<vertex_t> vertices) {
+  if (vertices.empty()) {
+    return {};
+  }
+
+  glm::vec3 lo = vertices[0].position, hi = vertices[0].position;
+  for (const vertex_t &v : vertices) {
+    lo = glm::min(lo, v.position);
+    hi = glm::max(hi, v.position);
+  }
+  return {lo, hi - lo};
+}
+
+inline std::vector<packed_vertex_t>
+pack_vertices(array_view_t<vertex_t> vertices, const quantization_t &q) {
+  std::vector<packed_vertex_t> packed(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const vertex_t &v = vertices[i];
+    packed_vertex_t &p = packed[i];
+
+    for (int k = 0; k < 3; k++) {
+      float t = q.scale[k] > 0.0f ? (v.position[k] - q.offset[k]) / q.scale[k]
+                                  : 0.0f;
+      p.position[k] =
+          (uint16_t)std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f);
+    }
+    p.position[3] = 0;
+    p.texture_coordinate[0] = detail::float_to_half(v.texture_coordinate.x);
+    p.texture_coordinate[1] = detail::float_to_half(v.texture_coordinate.y);
+
+    // handedness of the frame, the shader rebuilds B as cross(N, T) * w
+    float w = glm::dot(glm::cross(v.normal, v.tangent), v.bitangent);
+    p.normal = detail::pack_1010102(v.normal, 1.0f);
+    p.tangent = detail::pack_1010102(v.tangent, w);
+  }
+  return packed;
+}
+
+} // namespace cs7gv3::common
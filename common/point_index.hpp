@@ -0,0 +1,234 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CS7GV3_POINT_INDEX_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CS7GV3_POINT_INDEX_NEON 1
+#endif
+
+// A k-d tree over the vertex positions of a mesh, in the mesh's own space,
+// for picking. Inner nodes split the longest side of their box at the
+// median, leaves keep up to leaf_size points a coordinate per array, padded
+// to a multiple of four, so one SSE or NEON step measures four of them.
+namespace cs7gv3::common {
+
+class point_index_t {
+public:
+  static constexpr uint32_t leaf_size = 16;
+
+  struct hit_t {
+    uint32_t index; // into the vertices the index was built from
+    float distance;
+  };
+
+  point_index_t() = default;
+
+  explicit point_index_t(array_view_t<vertex_t> vertices) {
+    if (vertices.empty()) {
+      return;
+    }
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0);
+    _nodes.reserve(2 * vertices.size() / leaf_size + 1);
+    build(vertices, order, 0, order.size());
+  }
+
+  bool empty() const { return _nodes.empty(); }
+
+  // the point closest to p, if one is nearer than max_distance
+  bool nearest(const glm::vec3 &p, hit_t &hit,
+               float max_distance = INFINITY) const {
+    float best = max_distance * max_distance;
+    uint32_t best_slot = none;
+    traverse(p, best, [&](const node_t &leaf) {
+      uint32_t end = leaf.a + leaf.b;
+      for_each_quad(leaf, p, [&](uint32_t i, const float *d2) {
+        for (uint32_t k = 0; k < 4 && i + k < end; k++) {
+          if (d2[k] < best) {
+            best = d2[k];
+            best_slot = i + k;
+          }
+        }
+      });
+    });
+
+    if (best_slot == none) {
+      return false;
+    }
+    hit = {_ids[best_slot], std::sqrt(best)};
+    return true;
+  }
+
+  // appends every point within radius of p, in no particular order
+  void within(const glm::vec3 &p, float radius,
+              std::vector<hit_t> &hits) const {
+    float r2 = radius * radius;
+    traverse(p, r2, [&](const node_t &leaf) {
+      uint32_t end = leaf.a + leaf.b;
+      for_each_quad(leaf, p, [&](uint32_t i, const float *d2) {
+        for (uint32_t k = 0; k < 4 && i + k < end; k++) {
+          if (d2[k] <= r2) {
+            hits.push_back({_ids[i + k], std::sqrt(d2[k])});
+          }
+        }
+      });
+    });
+  }
+
+private:
+  static constexpr uint32_t leaf_axis = 3;
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // inner nodes split on axis and have children a and b, leaves hold
+  // points a .. a + b
+  struct node_t {
+    float split;
+    uint32_t axis;
+    uint32_t a;
+    uint32_t b;
+  };
+
+  std::vector<node_t> _nodes;
+  std::vector<float> _x;
+  std::vector<float> _y;
+  std::vector<float> _z;
+  std::vector<uint32_t> _ids;
+
+  uint32_t build(array_view_t<vertex_t> vertices,
+                 std::vector<uint32_t> &order, size_t begin, size_t end) {
+    uint32_t node = _nodes.size();
+    _nodes.push_back({});
+
+    if (end - begin <= leaf_size) {
+      uint32_t first = _ids.size();
+      for (size_t i = begin; i < end; i++) {
+        const glm::vec3 &p = vertices[order[i]].position;
+        _x.push_back(p.x);
+        _y.push_back(p.y);
+        _z.push_back(p.z);
+        _ids.push_back(order[i]);
+      }
+      // far enough away to never be the nearest
+      while (_ids.size() % 4) {
+        _x.push_back(1e30f);
+        _y.push_back(1e30f);
+        _z.push_back(1e30f);
+        _ids.push_back(none);
+      }
+      _nodes[node] = {0.0f, leaf_axis, first, (uint32_t)(end - begin)};
+      return node;
+    }
+
+    glm::vec3 lo = vertices[order[begin]].position, hi = lo;
+    for (size_t i = begin; i < end; i++) {
+      lo = glm::min(lo, vertices[order[i]].position);
+      hi = glm::max(hi, vertices[order[i]].position);
+    }
+    glm::vec3 size = hi - lo;
+    uint32_t axis = size.x >= size.y && size.x >= size.z ? 0
+                    : size.y >= size.z                   ? 1
+                                                         : 2;
+
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid,
+                     order.begin() + end, [&](uint32_t a, uint32_t b) {
+                       return vertices[a].position[axis] <
+                              vertices[b].position[axis];
+                     });
+    float split = vertices[order[mid]].position[axis];
+
+    uint32_t a = build(vertices, order, begin, mid);
+    uint32_t b = build(vertices, order, mid, end);
+    _nodes[node] = {split, axis, a, b};
+    return node;
+  }
+
+  // visits the leaves that may hold a point closer than sqrt(bound), near
+  // side first. visit may shrink bound.
+  template <typename F>
+  void traverse(const glm::vec3 &p, const float &bound, F visit) const {
+    if (_nodes.empty()) {
+      return;
+    }
+
+    // the median split keeps the depth near log2 of the leaf count
+    struct entry_t {
+      uint32_t node;
+      float d2; // to the node's side of every split above it
+    };
+    entry_t stack[64];
+    int top = 0;
+    stack[top++] = {0, 0.0f};
+    while (top > 0) {
+      entry_t e = stack[--top];
+      if (e.d2 > bound) {
+        continue;
+      }
+      const node_t &node = _nodes[e.node];
+      if (node.axis == leaf_axis) {
+        visit(node);
+        continue;
+      }
+
+      float d = p[node.axis] - node.split;
+      uint32_t near = d < 0.0f ? node.a : node.b;
+      uint32_t far = d < 0.0f ? node.b : node.a;
+      stack[top++] = {far, std::max(e.d2, d * d)};
+      stack[top++] = {near, e.d2};
+    }
+  }
+
+  // squared distances from p to the leaf's points four at a time, the
+  // padding past the leaf's count included
+  template <typename F>
+  void for_each_quad(const node_t &leaf, const glm::vec3 &p, F f) const {
+    alignas(16) float d2[4];
+#ifdef CS7GV3_POINT_INDEX_SSE
+    __m128 px = _mm_set1_ps(p.x);
+    __m128 py = _mm_set1_ps(p.y);
+    __m128 pz = _mm_set1_ps(p.z);
+    for (uint32_t i = leaf.a; i < leaf.a + leaf.b; i += 4) {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(&_x[i]), px);
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(&_y[i]), py);
+      __m128 dz = _mm_sub_ps(_mm_loadu_ps(&_z[i]), pz);
+      _mm_store_ps(d2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                             _mm_mul_ps(dy, dy)),
+                                  _mm_mul_ps(dz, dz)));
+      f(i, d2);
+    }
+#elif defined(CS7GV3_POINT_INDEX_NEON)
+    float32x4_t px = vdupq_n_f32(p.x);
+    float32x4_t py = vdupq_n_f32(p.y);
+    float32x4_t pz = vdupq_n_f32(p.z);
+    for (uint32_t i = leaf.a; i < leaf.a + leaf.b; i += 4) {
+      float32x4_t dx = vsubq_f32(vld1q_f32(&_x[i]), px);
+      float32x4_t dy = vsubq_f32(vld1q_f32(&_y[i]), py);
+      float32x4_t dz = vsubq_f32(vld1q_f32(&_z[i]), pz);
+      vst1q_f32(d2, vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)),
+                              vmulq_f32(dz, dz)));
+      f(i, d2);
+    }
+#else
+    for (uint32_t i = leaf.a; i < leaf.a + leaf.b; i += 4) {
+      for (uint32_t k = 0; k < 4; k++) {
+        glm::vec3 d = glm::vec3(_x[i + k], _y[i + k], _z[i + k]) - p;
+        d2[k] = glm::dot(d, d);
+      }
+      f(i, d2);
+    }
+#endif
+  }
+};
+
+} // namespace cs7gv3::common
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "figine/figine.hpp"
+
+// The perspective every pass draws with. The depth range is kept here once,
+// so the scene, the frame block, the deferred reconstruction and the light
+// clusters cannot disagree. figine's own objects use the same range.
+namespace cs7gv3::common {
+
+inline float near_plane = 0.1f;
+inline float far_plane = 100.0f;
+
+inline glm::mat4 projection_matrix(const figine::core::camera_t &camera) {
+  return glm::perspective(glm::radians(camera.zoom),
+                          figine::global::win_mgr::aspect_ratio(), near_plane,
+                          far_plane);
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Draws collected over a frame and replayed in the order of a 64-bit key, so
+// draws sharing a program and a texture run back to back whatever order the
+// main loop lists objects in:
+//
+//   queue.clear();
+//   teapot.submit(queue, shader);
+//   skybox.submit(queue);
+//   queue.execute();
+//
+// keys from render_key(), highest bits first:
+//   opaque       pass:2 program:14 material:16 depth:32   front to back
+//   skybox       pass:2
+//   transparent  pass:2 ~depth:32 program:14 material:16  back to front
+//
+// the skybox goes after the opaque pass, it only fills what is still at the
+// far plane, and before the transparent one, which does not write depth and
+// would be painted over.
+namespace cs7gv3::common {
+
+enum class render_pass_t : uint64_t {
+  opaque = 0,
+  skybox = 1,
+  transparent = 2,
+};
+
+// program and material are GL names, only their low bits go in. a clash
+// costs a state change, never a wrong draw.
+inline uint64_t render_key(render_pass_t pass, uint32_t program = 0,
+                           uint32_t material = 0, float depth = 0.0f) {
+  // the bits of a non-negative float order like the float
+  depth = depth > 0.0f ? depth : 0.0f;
+  uint32_t d;
+  std::memcpy(&d, &depth, sizeof(d));
+
+  uint64_t state = (uint64_t)(program & 0x3fff) << 16 | (material & 0xffff);
+  uint64_t key = (uint64_t)pass << 62;
+  switch (pass) {
+  case render_pass_t::opaque:
+    return key | state << 32 | d;
+  case render_pass_t::transparent:
+    return key | (uint64_t)~d << 30 | state;
+  default:
+    return key;
+  }
+}
+
+// what a packet calls back into, item tells an object's packets apart
+class renderable_if {
+public:
+  virtual ~renderable_if() = default;
+  virtual void draw_item(const figine::core::shader_if *shader,
+                         uint32_t item) = 0;
+};
+
+struct render_packet_t {
+  uint64_t key;
+  renderable_if *object;
+  const figine::core::shader_if *shader;
+  uint32_t item;
+};
+
+class render_queue_t {
+public:
+  void clear() { _packets.clear(); }
+
+  void submit(uint64_t key, renderable_if *object,
+              const figine::core::shader_if *shader = nullptr,
+              uint32_t item = 0) {
+    _packets.push_back({key, object, shader, item});
+  }
+
+  size_t size() const { return _packets.size(); }
+
+  // sorts and draws, the transparent pass blends without writing depth
+  void execute() {
+    sort();
+
+    render_pass_t pass = render_pass_t::opaque;
+    for (const sort_entry_t &e : _sorted) {
+      const render_packet_t &packet = _packets[e.index];
+      render_pass_t next = (render_pass_t)(packet.key >> 62);
+      if (next != pass && next == render_pass_t::transparent) {
+        gl_state.enable(GL_BLEND, true);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl_state.depth_mask(false);
+      }
+      pass = next;
+      packet.object->draw_item(packet.shader, packet.item);
+    }
+
+    if (pass == render_pass_t::transparent) {
+      gl_state.enable(GL_BLEND, false);
+      gl_state.depth_mask(true);
+    }
+  }
+
+private:
+  struct sort_entry_t {
+    uint64_t key;
+    uint32_t index;
+  };
+
+  std::vector<render_packet_t> _packets;
+  std::vector<sort_entry_t> _sorted;
+  std::vector<sort_entry_t> _scratch;
+
+  // LSD radix sort on bytes, stable so equal keys draw in submission order.
+  // a byte every key shares, like most of the pass and program bits, costs
+  // one counting sweep and no scatter.
+  void sort() {
+    size_t n = _packets.size();
+    _sorted.resize(n);
+    _scratch.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      _sorted[i] = {_packets[i].key, (uint32_t)i};
+    }
+    if (n < 2) {
+      return;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+      size_t offsets[256] = {};
+      for (const sort_entry_t &e : _sorted) {
+        offsets[(e.key >> shift) & 0xff]++;
+      }
+      if (offsets[(_sorted[0].key >> shift) & 0xff] == n) {
+        continue;
+      }
+
+      size_t sum = 0;
+      for (size_t &offset : offsets) {
+        size_t count = offset;
+        offset = sum;
+        sum += count;
+      }
+      for (const sort_entry_t &e : _sorted) {
+        _scratch[offsets[(e.key >> shift) & 0xff]++] = e;
+      }
+      _sorted.swap(_scratch);
+    }
+  }
+};
+
+} // namespace cs7gv3::common
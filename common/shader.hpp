@@ -0,0 +1,355 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "mapped_file.hpp"
+#include "uniform.hpp"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Programs that link on first use and keep their linked binary on disk. The
+// cache key hashes the sources together with the driver strings, so a new
+// driver misses instead of being handed a binary it may reject, and a
+// binary the driver still refuses is simply linked again from source.
+// shader_variants_t builds one such program per set of feature #defines.
+namespace cs7gv3::common {
+
+// linked programs live here, next to the mesh cache
+inline std::string program_cache_dir = ".cache/program";
+
+constexpr uint32_t program_cache_magic = 0x42504746; // "FGPB"
+
+struct program_cache_header_t {
+  uint32_t magic;
+  uint32_t format;
+  uint64_t key;
+  uint64_t size;
+};
+
+inline uint64_t program_key(const uint8_t *vs, const uint8_t *fs) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  // the terminator goes in too, so text moving between strings is a miss
+  auto add = [&hash](const void *s) {
+    auto str = s ? static_cast<const char *>(s) : "";
+    hash = hash_bytes(reinterpret_cast<const uint8_t *>(str),
+                      std::strlen(str) + 1, hash);
+  };
+  add(vs);
+  add(fs);
+  add(glGetString(GL_VENDOR));
+  add(glGetString(GL_RENDERER));
+  add(glGetString(GL_VERSION));
+  return hash;
+}
+
+inline std::string program_cache_path(uint64_t key) {
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016" PRIx64, key);
+  return program_cache_dir + "/" + hex + ".bin";
+}
+
+// GL_ARB_get_program_binary, core since 4.1. a driver may expose the entry
+// points and still list no format, then there is nothing to store.
+inline bool program_binary_supported() {
+  static int supported = -1;
+  if (supported < 0) {
+    GLint n = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+    supported = n > 0;
+  }
+  return supported == 1;
+}
+
+// 0 on a miss or when the driver rejects the binary
+inline GLuint load_program_binary(const std::string &path, uint64_t key) {
+  mapped_file_t file;
+  if (!file.open(path) || file.size() < sizeof(program_cache_header_t)) {
+    return 0;
+  }
+
+  auto header = reinterpret_cast<const program_cache_header_t *>(file.data());
+  if (header->magic != program_cache_magic || header->key != key ||
+      header->size > file.size() - sizeof(program_cache_header_t)) {
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header->format, header + 1, header->size);
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+inline bool write_program_binary(const std::string &path, uint64_t key,
+                                 GLuint program) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> data(sizeof(program_cache_header_t) + length);
+  GLsizei written = 0;
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &written, &format,
+                     data.data() + sizeof(program_cache_header_t));
+
+  program_cache_header_t header{};
+  header.magic = program_cache_magic;
+  header.format = format;
+  header.key = key;
+  header.size = written;
+  std::memcpy(data.data(), &header, sizeof(header));
+  data.resize(sizeof(header) + written);
+
+  std::error_code ec;
+  std::filesystem::create_directories(program_cache_dir, ec);
+
+  // same as the mesh cache, never leave a torn file behind or share one
+  std::string tmp_path = temp_path(path);
+  FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+  if (!fp) {
+    LOG_ERR("failed to write program cache: %s", tmp_path.c_str());
+    return false;
+  }
+  bool ok = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+  ok = std::fclose(fp) == 0 && ok;
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERR("failed to write program cache: %s", path.c_str());
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// links since startup, split by where the program came from, so a cold and
+// a warm start can be told apart in the consoles
+struct program_stats_t {
+  size_t loaded = 0;
+  size_t compiled = 0;
+  double loaded_ms = 0.0;
+  double compiled_ms = 0.0;
+};
+
+inline program_stats_t program_stats;
+
+namespace detail {
+
+inline GLuint compile_stage(GLenum type, const uint8_t *source) {
+  GLuint shader = glCreateShader(type);
+  auto src = reinterpret_cast<const char *>(source);
+  glShaderSource(shader, 1, &src, nullptr);
+  glCompileShader(shader);
+
+  GLint status = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (status != GL_TRUE) {
+    char log[1024] = {};
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    LOG_ERR("failed to compile %s shader: %s",
+            type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+  }
+  return shader;
+}
+
+// 0 when compiling or linking fails, the log says why
+inline GLuint link_program(const uint8_t *vs, const uint8_t *fs) {
+  GLuint program = glCreateProgram();
+  GLuint stages[2] = {compile_stage(GL_VERTEX_SHADER, vs),
+                      compile_stage(GL_FRAGMENT_SHADER, fs)};
+  for (GLuint stage : stages) {
+    glAttachShader(program, stage);
+  }
+  if (program_binary_supported()) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  }
+  glLinkProgram(program);
+  for (GLuint stage : stages) {
+    glDetachShader(program, stage);
+    glDeleteShader(stage);
+  }
+
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    char log[1024] = {};
+    glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+    LOG_ERR("failed to link program: %s", log);
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+} // namespace detail
+
+// a shader_if that owns its own program. link() right away for the
+// programs a scene starts with, anything else links on its first bind().
+//
+// figine's build() and use() are not virtual, so shader_t does not reuse
+// their names: hiding them would still leave figine's program, never
+// built, behind every shader_if reference. from() recovers the shader_t of
+// such a reference instead.
+class shader_t : public figine::core::shader_if {
+public:
+  shader_t(const uint8_t *vs, const uint8_t *fs)
+      : figine::core::shader_if(vs, fs), _vs(vs), _fs(fs) {
+    live().insert(this);
+  }
+
+  ~shader_t() {
+    live().erase(this);
+    if (_program) {
+      forget_uniforms(_program);
+      // shaders are mostly globals, destroyed after the context
+      if (glfwGetCurrentContext()) {
+        gl_state.delete_program(_program);
+      }
+    }
+  }
+
+  shader_t(const shader_t &) = delete;
+  shader_t &operator=(const shader_t &) = delete;
+
+  // the shader_t behind a shader_if, nullptr for any other shader. figine's
+  // base has no virtual function to dynamic_cast through.
+  static const shader_t *from(const figine::core::shader_if &shader) {
+    return live().count(&shader) ? static_cast<const shader_t *>(&shader)
+                                 : nullptr;
+  }
+
+  // loads the program from the cache or links it, once
+  void link() const {
+    if (_tried) {
+      return;
+    }
+    _tried = true;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    uint64_t key = program_key(_vs, _fs);
+    std::string path = program_cache_path(key);
+
+    bool hit = program_binary_supported() &&
+               (_program = load_program_binary(path, key)) != 0;
+    if (!hit) {
+      _program = detail::link_program(_vs, _fs);
+      if (_program && program_binary_supported()) {
+        write_program_binary(path, key, _program);
+      }
+    }
+
+    double ms =
+        std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    (hit ? program_stats.loaded : program_stats.compiled)++;
+    (hit ? program_stats.loaded_ms : program_stats.compiled_ms) += ms;
+    LOG_INFO("program %016" PRIx64 ": %s in %.2f ms", key,
+             hit ? "loaded from cache" : "compiled", ms);
+  }
+
+  // links first if needed, then makes the program current
+  void bind() const {
+    link();
+    gl_state.use_program(_program);
+  }
+
+  bool linked() const { return _program != 0; }
+
+  // links first if it has not been tried yet, 0 when that failed
+  GLuint program() const {
+    link();
+    return _program;
+  }
+
+private:
+  const uint8_t *_vs;
+  const uint8_t *_fs;
+  mutable GLuint _program = 0;
+  // a failed link is not retried every frame
+  mutable bool _tried = false;
+
+  static std::unordered_set<const figine::core::shader_if *> &live() {
+    static std::unordered_set<const figine::core::shader_if *> shaders;
+    return shaders;
+  }
+};
+
+// one shader_t per combination of features, so a switch in the console picks
+// a program instead of every fragment testing a uniform bool. feature i is
+// bit i of the flags and comes in as "#define <features[i]>" right after
+// #version, the sources test it with #ifdef. variants link on first use.
+class shader_variants_t {
+public:
+  shader_variants_t(const uint8_t *vs, const uint8_t *fs,
+                    std::vector<std::string> features)
+      : _vs(reinterpret_cast<const char *>(vs)),
+        _fs(reinterpret_cast<const char *>(fs)),
+        _features(std::move(features)) {}
+
+  shader_t &variant(uint32_t flags) {
+    auto it = _variants.find(flags);
+    if (it == _variants.end()) {
+      std::string defines;
+      for (size_t i = 0; i < _features.size(); i++) {
+        if (flags & (1u << i)) {
+          defines += "#define " + _features[i] + "\n";
+        }
+      }
+      it = _variants
+               .emplace(flags, std::make_unique<variant_t>(
+                                   inject(_vs, defines), inject(_fs, defines)))
+               .first;
+    }
+    return it->second->shader;
+  }
+
+  // links the variant up front, for the one a scene starts with
+  void build(uint32_t flags) { variant(flags).link(); }
+
+  size_t size() const { return _variants.size(); }
+
+private:
+  // the sources have to outlive the program, shader_t keeps pointers
+  struct variant_t {
+    std::string vs;
+    std::string fs;
+    shader_t shader;
+
+    variant_t(std::string v, std::string f)
+        : vs(std::move(v)), fs(std::move(f)),
+          shader(reinterpret_cast<const uint8_t *>(vs.c_str()),
+                 reinterpret_cast<const uint8_t *>(fs.c_str())) {}
+  };
+
+  const char *_vs;
+  const char *_fs;
+  std::vector<std::string> _features;
+  std::unordered_map<uint32_t, std::unique_ptr<variant_t>> _variants;
+
+  // #version has to stay the first line
+  static std::string inject(std::string source, const std::string &defines) {
+    size_t version = source.find("#version");
+    size_t line = version == std::string::npos
+                      ? 0
+                      : source.find('\n', version);
+    line = line == std::string::npos ? source.size() : line + 1;
+    source.insert(line, defines);
+    return source;
+  }
+};
+
+} // namespace cs7gv3::common
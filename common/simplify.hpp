@@ -0,0 +1,311 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "point_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error edge collapse (Garland and Heckbert 1997) on the index
+// buffer only: a vertex is collapsed onto one of its neighbours, so every
+// LOD shares the vertex buffer of the full mesh. Borders and uv/normal seams
+// are locked, collapsing them would open cracks.
+namespace cs7gv3::common {
+
+// triangle ratios of the LOD chain built below the full mesh
+inline std::vector<float> lod_ratios = {0.5f, 0.25f, 0.125f};
+
+namespace detail {
+
+// symmetric 4x4 of the squared distance to a set of planes
+struct quadric_t {
+  double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0,
+         zw = 0, ww = 0;
+
+  void add_plane(double a, double b, double c, double d) {
+    xx += a * a, xy += a * b, xz += a * c, xw += a * d;
+    yy += b * b, yz += b * c, yw += b * d;
+    zz += c * c, zw += c * d;
+    ww += d * d;
+  }
+
+  quadric_t &operator+=(const quadric_t &o) {
+    xx += o.xx, xy += o.xy, xz += o.xz, xw += o.xw;
+    yy += o.yy, yz += o.yz, yw += o.yw;
+    zz += o.zz, zw += o.zw;
+    ww += o.ww;
+    return *this;
+  }
+
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x +
+               yy * y * y + 2 * yz * y * z + 2 * yw * y + zz * z * z +
+               2 * zw * z + ww;
+    return std::max(e, 0.0);
+  }
+};
+
+inline glm::vec3 triangle_normal(const glm::vec3 &a, const glm::vec3 &b,
+                                 const glm::vec3 &c) {
+  return glm::cross(b - a, c - a);
+}
+
+struct collapse_t {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+} // namespace detail
+
+// collapses edges until at most target_indices / 3 triangles are left or
+// nothing more can go. error receives a bound on how far the surface
+// moved, in model units.
+inline std::vector<uint32_t>
+simplify(const std::vector<uint32_t> &indices,
+         const std::vector<vertex_t> &vertices, size_t target_indices,
+         float *error = nullptr) {
+  using namespace detail;
+  const size_t n = vertices.size();
+
+  // vertices sharing a position, the first one stands for all of them
+  auto bytes = [&](uint32_t i) {
+    return reinterpret_cast<const uint8_t *>(&vertices[i].position);
+  };
+  auto hash = [&](uint32_t i) { return hash_bytes(bytes(i), 12); };
+  auto equal = [&](uint32_t a, uint32_t b) {
+    return std::memcmp(bytes(a), bytes(b), 12) == 0;
+  };
+  std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)>
+      positions(n, hash, equal);
+  std::vector<uint32_t> canonical(n);
+  std::vector<uint32_t> wedges(n, 0);
+  for (uint32_t v = 0; v < n; v++) {
+    canonical[v] = positions.emplace(v, v).first->second;
+    wedges[canonical[v]]++;
+  }
+
+  std::vector<bool> locked(n, false);
+  for (uint32_t v = 0; v < n; v++) {
+    locked[v] = wedges[canonical[v]] > 1;
+  }
+
+  // edges used by a single triangle are on a border
+  std::unordered_map<uint64_t, uint32_t> edges;
+  auto edge_key = [&](uint32_t a, uint32_t b) {
+    a = canonical[a], b = canonical[b];
+    return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+  };
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (int e = 0; e < 3; e++) {
+      edges[edge_key(indices[i + e], indices[i + (e + 1) % 3])]++;
+    }
+  }
+  std::vector<bool> border(n, false);
+  for (const auto &[key, count] : edges) {
+    if (count == 1) {
+      border[key >> 32] = true;
+      border[key & 0xffffffff] = true;
+    }
+  }
+  for (uint32_t v = 0; v < n; v++) {
+    locked[v] = locked[v] || border[canonical[v]];
+  }
+
+  std::vector<quadric_t> quadrics(n);
+  std::vector<std::vector<uint32_t>> triangles(n);
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const glm::vec3 &a = vertices[indices[i]].position;
+    glm::vec3 normal = triangle_normal(a, vertices[indices[i + 1]].position,
+                                       vertices[indices[i + 2]].position);
+    float len = glm::length(normal);
+    if (len > 0.0f) {
+      normal /= len;
+      quadric_t q;
+      q.add_plane(normal.x, normal.y, normal.z, -glm::dot(normal, a));
+      for (int c = 0; c < 3; c++) {
+        quadrics[canonical[indices[i + c]]] += q;
+      }
+    }
+    for (int c = 0; c < 3; c++) {
+      triangles[indices[i + c]].push_back(i / 3);
+    }
+  }
+
+  std::vector<uint32_t> out = indices;
+  std::vector<bool> dead(indices.size() / 3, false);
+  size_t live = indices.size() / 3;
+  const size_t target = target_indices / 3;
+  float max_error = 0.0f;
+
+  auto flips = [&](uint32_t from, uint32_t to) {
+    const glm::vec3 &p = vertices[to].position;
+    for (uint32_t t : triangles[from]) {
+      uint32_t *tri = &out[t * 3];
+      if (dead[t] || tri[0] == to || tri[1] == to || tri[2] == to) {
+        continue;
+      }
+      glm::vec3 c[3], moved[3];
+      for (int k = 0; k < 3; k++) {
+        c[k] = vertices[tri[k]].position;
+        moved[k] = tri[k] == from ? p : c[k];
+      }
+      if (glm::dot(triangle_normal(c[0], c[1], c[2]),
+                   triangle_normal(moved[0], moved[1], moved[2])) <= 0.0f) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  std::vector<collapse_t> candidates;
+  std::vector<bool> touched(n);
+  // how far the surface around each vertex may have moved
+  std::vector<float> deviation(n, 0.0f);
+  while (live > target) {
+    candidates.clear();
+    for (size_t t = 0; t < dead.size(); t++) {
+      if (dead[t]) {
+        continue;
+      }
+      for (int e = 0; e < 3; e++) {
+        uint32_t a = out[t * 3 + e], b = out[t * 3 + (e + 1) % 3];
+        if (a == b) {
+          continue;
+        }
+        quadric_t q = quadrics[canonical[a]];
+        q += quadrics[canonical[b]];
+        const glm::vec3 &pa = vertices[a].position;
+        const glm::vec3 &pb = vertices[b].position;
+        if (!locked[a]) {
+          candidates.push_back({a, b, q.error(pb)});
+        }
+        if (!locked[b]) {
+          candidates.push_back({b, a, q.error(pa)});
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const collapse_t &a, const collapse_t &b) {
+                return a.cost < b.cost;
+              });
+
+    // independent collapses only, the costs of the rest are stale now
+    std::fill(touched.begin(), touched.end(), false);
+    size_t collapsed = 0;
+    for (const collapse_t &c : candidates) {
+      if (live <= target) {
+        break;
+      }
+      if (touched[c.from] || touched[c.to] || flips(c.from, c.to)) {
+        continue;
+      }
+
+      for (uint32_t t : triangles[c.from]) {
+        if (dead[t]) {
+          continue;
+        }
+        uint32_t *tri = &out[t * 3];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+          dead[t] = true;
+          live--;
+          continue;
+        }
+        for (int k = 0; k < 3; k++) {
+          tri[k] = tri[k] == c.from ? c.to : tri[k];
+        }
+        triangles[c.to].push_back(t);
+      }
+      triangles[c.from].clear();
+      quadrics[canonical[c.to]] += quadrics[canonical[c.from]];
+
+      touched[c.from] = touched[c.to] = true;
+      // the surface near from moves no further than from did, plus whatever
+      // it had already moved. the quadric distance is an average over the
+      // planes and can be far below that.
+      float moved = glm::distance(vertices[c.from].position,
+                                  vertices[c.to].position);
+      float &d = deviation[canonical[c.to]];
+      d = std::max(d, deviation[canonical[c.from]] + moved);
+      max_error = std::max(max_error, d);
+      collapsed++;
+    }
+
+    if (collapsed == 0) {
+      break;
+    }
+  }
+
+  std::vector<uint32_t> result;
+  result.reserve(live * 3);
+  for (size_t t = 0; t < dead.size(); t++) {
+    if (!dead[t]) {
+      result.insert(result.end(), out.begin() + t * 3,
+                    out.begin() + t * 3 + 3);
+    }
+  }
+
+  if (error) {
+    *error = max_error;
+  }
+  return result;
+}
+
+// the largest distance from a vertex to the nearest one the level still
+// uses, no vertex of the full surface is further from the level's
+inline float lod_deviation(const std::vector<vertex_t> &vertices,
+                           const std::vector<uint32_t> &level) {
+  std::vector<bool> used(vertices.size(), false);
+  std::vector<vertex_t> kept;
+  for (uint32_t i : level) {
+    if (!used[i]) {
+      used[i] = true;
+      kept.push_back(vertices[i]);
+    }
+  }
+  point_index_t index({kept.data(), kept.size()});
+
+  float deviation = 0.0f;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    point_index_t::hit_t hit;
+    if (!used[i] && index.nearest(vertices[i].position, hit)) {
+      deviation = std::max(deviation, hit.distance);
+    }
+  }
+  return deviation;
+}
+
+// appends a level per lod_ratios to the index buffer, each simplified from
+// the previous one and ordered for the vertex cache. stops early once a
+// level barely shrinks, the locked edges then dominate the mesh.
+inline void build_lods(mesh_data_t &mesh) {
+  const size_t n_indices = mesh.indices.size();
+  mesh.lods = {{0, (uint32_t)n_indices, 0.0f}};
+
+  std::vector<uint32_t> previous = mesh.indices;
+  float error = 0.0f;
+  for (float ratio : lod_ratios) {
+    size_t target = (size_t)(n_indices / 3 * ratio) * 3;
+    std::vector<uint32_t> level = simplify(previous, mesh.vertices, target);
+    if (level.empty() || level.size() > previous.size() * 9 / 10) {
+      break;
+    }
+
+    // measured rather than summed over the steps, which grows far past
+    // it: every vertex of the full mesh is within error of the level
+    error = std::max(error, lod_deviation(mesh.vertices, level));
+    level = optimize_vertex_cache(level, mesh.vertices.size());
+    mesh.lods.push_back(
+        {(uint32_t)mesh.indices.size(), (uint32_t)level.size(), error});
+    mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+    previous = std::move(level);
+  }
+}
+
+} // namespace cs7gv3::common
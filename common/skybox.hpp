@@ -0,0 +1,124 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "render_queue.hpp"
+#include "shader.hpp"
+#include "texture_registry.hpp"
+#include "uniform.hpp"
+#include "uniform_block.hpp"
+
+#include <string>
+#include <vector>
+
+namespace cs7gv3::common {
+
+constexpr uint8_t skybox_vs[] = R"(
+#version 330 core
+)" CS7GV3_FRAME_BLOCK_GLSL R"(
+layout(location = 0) in vec3 pos_in;
+
+out vec3 texture_coordinate;
+
+void main() {
+    texture_coordinate = pos_in;
+    // drop the translation and pin the box to the far plane
+    vec4 pos = projection * mat4(mat3(view)) * vec4(pos_in, 1.0);
+    gl_Position = pos.xyww;
+}
+)";
+
+constexpr uint8_t skybox_fs[] = R"(
+#version 330 core
+
+in vec3 texture_coordinate;
+
+out vec4 frag_color;
+
+uniform samplerCube skybox;
+
+void main() {
+    frag_color = texture(skybox, texture_coordinate);
+}
+)";
+
+namespace skybox_uniforms {
+constexpr uniform_t skybox = "skybox";
+} // namespace skybox_uniforms
+
+// drop-in for figine's skybox_t whose cubemap comes from the texture
+// registry, so objects reflecting the same faces share one texture with it.
+// draw it last, it only fills what is still at the far plane, submit() puts
+// it in the skybox pass for that. the camera comes from the frame block, see
+// update_frame().
+class skybox_t : public renderable_if {
+public:
+  skybox_t(const std::vector<std::string> &faces,
+           figine::core::camera_t *camera)
+      : faces(faces), camera(camera) {}
+
+  const std::vector<std::string> faces;
+  figine::core::camera_t *camera;
+
+  void init() {
+    _shader.link();
+    texture = texture_registry::load_cubemap(faces);
+
+    static const float vertices[] = {
+        -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,
+        -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, 1.0f,  1.0f,
+        -1.0f, 1.0f,  1.0f,  1.0f,  1.0f,  -1.0f, 1.0f,  1.0f,
+    };
+    static const uint8_t indices[] = {
+        0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4, 0, 3, 7, 7, 4, 0,
+        1, 5, 6, 6, 2, 1, 3, 2, 6, 6, 7, 3, 0, 1, 5, 5, 4, 0,
+    };
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    glGenBuffers(1, &_ebo);
+
+    gl_state.bind_vertex_array(_vao);
+    defer(gl_state.bind_vertex_array(0));
+
+    gl_state.bind_array_buffer(_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+                 GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), NULL);
+  }
+
+  void submit(render_queue_t &queue) {
+    queue.submit(render_key(render_pass_t::skybox), this);
+  }
+
+  void draw_item(const figine::core::shader_if *, uint32_t) override {
+    loop();
+  }
+
+  void loop() {
+    gl_state.depth_func(GL_LEQUAL);
+    defer(gl_state.depth_func(GL_LESS));
+
+    _shader.bind();
+    const uniform_table_t &uniforms = current_uniforms();
+    uniforms.set(skybox_uniforms::skybox, 0);
+
+    gl_state.bind_texture(0, GL_TEXTURE_CUBE_MAP, texture->bind_id());
+    gl_state.bind_vertex_array(_vao);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+  }
+
+  texture_ref_t texture;
+
+private:
+  shader_t _shader{skybox_vs, skybox_fs};
+  GLuint _vao = 0;
+  GLuint _vbo = 0;
+  GLuint _ebo = 0;
+};
+
+} // namespace cs7gv3::common
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "packed_vertex.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Static geometry suballocated out of a few large buffers, one pool per
+// vertex layout. Every block has one vertex array over one vertex and one
+// index buffer, so meshes in a block draw without switching vertex arrays
+// and, sharing a material, in one glMultiDrawElementsBaseVertex. Indices
+// stay relative to their mesh, draws add the base vertex.
+//
+// Blocks are never resized, a streamed upload may still be writing into one,
+// and nothing is freed, static geometry lives as long as the program.
+namespace cs7gv3::common {
+
+// the attributes of either layout, on the vertex array and the
+// GL_ARRAY_BUFFER bound. integer formats are normalized, the shader sees
+// [0, 1] or [-1, 1].
+inline void set_vertex_layout(bool packed) {
+  auto attrib = [](GLuint location, GLint size, GLenum type, GLsizei stride,
+                   size_t offset) {
+    bool normalized = type != GL_FLOAT && type != GL_HALF_FLOAT;
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, size, type, normalized, stride,
+                          (void *)offset);
+  };
+
+  if (packed) {
+    constexpr GLsizei stride = sizeof(packed_vertex_t);
+    attrib(0, 3, GL_UNSIGNED_SHORT, stride,
+           offsetof(packed_vertex_t, position));
+    attrib(1, 4, GL_INT_2_10_10_10_REV, stride,
+           offsetof(packed_vertex_t, normal));
+    attrib(2, 2, GL_HALF_FLOAT, stride,
+           offsetof(packed_vertex_t, texture_coordinate));
+    attrib(3, 4, GL_INT_2_10_10_10_REV, stride,
+           offsetof(packed_vertex_t, tangent));
+    return;
+  }
+
+  constexpr GLsizei stride = sizeof(vertex_t);
+  attrib(0, 3, GL_FLOAT, stride, offsetof(vertex_t, position));
+  attrib(1, 3, GL_FLOAT, stride, offsetof(vertex_t, normal));
+  attrib(2, 2, GL_FLOAT, stride, offsetof(vertex_t, texture_coordinate));
+  attrib(3, 3, GL_FLOAT, stride, offsetof(vertex_t, tangent));
+  attrib(4, 3, GL_FLOAT, stride, offsetof(vertex_t, bitangent));
+}
+
+// where a mesh landed, offsets are in vertices and indices
+struct geometry_range_t {
+  GLuint vao = 0;
+  GLuint vbo = 0;
+  GLuint ebo = 0;
+  GLint base_vertex = 0;
+  uint32_t first_index = 0;
+};
+
+class geometry_pool_t {
+public:
+  // the first block holds the first mesh, each next one twice the last up
+  // to this much. a larger mesh gets a block of its own size.
+  static constexpr size_t max_block_vertex_bytes = 16 * 1024 * 1024;
+  static constexpr size_t max_block_indices = 2 * 1024 * 1024;
+
+  explicit geometry_pool_t(bool packed) : _packed(packed) {}
+
+  geometry_pool_t(const geometry_pool_t &) = delete;
+  geometry_pool_t &operator=(const geometry_pool_t &) = delete;
+
+  // GL thread only, the range is uninitialized storage
+  geometry_range_t allocate(size_t vertices, size_t indices) {
+    auto fits = [&](const block_t &b) {
+      return b.vertices + vertices <= b.vertex_capacity &&
+             b.indices + indices <= b.index_capacity;
+    };
+    auto it = std::find_if(_blocks.begin(), _blocks.end(), fits);
+    if (it == _blocks.end()) {
+      size_t next_vertices = 0, next_indices = 0;
+      if (!_blocks.empty()) {
+        next_vertices = std::min(_blocks.back().vertex_capacity * 2,
+                                 max_block_vertex_bytes / vertex_size());
+        next_indices =
+            std::min(_blocks.back().index_capacity * 2, max_block_indices);
+      }
+      _blocks.push_back(create_block(std::max(vertices, next_vertices),
+                                     std::max(indices, next_indices)));
+      it = _blocks.end() - 1;
+    }
+
+    geometry_range_t range;
+    range.vao = it->vao;
+    range.vbo = it->vbo;
+    range.ebo = it->ebo;
+    range.base_vertex = it->vertices;
+    range.first_index = it->indices;
+    it->vertices += vertices;
+    it->indices += indices;
+    return range;
+  }
+
+  size_t vertex_size() const {
+    return _packed ? sizeof(packed_vertex_t) : sizeof(vertex_t);
+  }
+
+  size_t blocks() const { return _blocks.size(); }
+
+private:
+  struct block_t {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    size_t vertex_capacity = 0;
+    size_t index_capacity = 0;
+    size_t vertices = 0;
+    size_t indices = 0;
+  };
+
+  bool _packed;
+  std::vector<block_t> _blocks;
+
+  block_t create_block(size_t vertices, size_t indices) {
+    block_t b;
+    b.vertex_capacity = vertices;
+    b.index_capacity = indices;
+    glGenVertexArrays(1, &b.vao);
+    glGenBuffers(1, &b.vbo);
+    glGenBuffers(1, &b.ebo);
+
+    gl_state.bind_vertex_array(b.vao);
+    defer(gl_state.bind_vertex_array(0));
+
+    gl_state.bind_array_buffer(b.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices * vertex_size(), nullptr,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices * sizeof(uint32_t), nullptr,
+                 GL_STATIC_DRAW);
+    set_vertex_layout(_packed);
+    return b;
+  }
+};
+
+// the pool of a vertex layout
+inline geometry_pool_t &geometry_pool(bool packed) {
+  static geometry_pool_t pools[2] = {geometry_pool_t(false),
+                                     geometry_pool_t(true)};
+  return pools[packed];
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "texture.hpp"
+#include "texture_compress.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Asset streaming: decoding runs on the thread pool, the GL side is drained a
+// few megabytes per frame by update(), which must be called once per frame
+// from the thread that owns the GL context. Everything but the pool work is
+// GL thread only, so there is no locking here.
+namespace cs7gv3::common::streamer {
+
+// bytes copied into GL buffers per update()
+inline size_t frame_budget = 4 * 1024 * 1024;
+
+namespace detail {
+
+struct job_t {
+  GLuint object = 0; // buffer, or texture for image jobs
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  size_t offset = 0;
+  // where data goes in a buffer, image jobs start their PBO at 0
+  size_t base = 0;
+  std::shared_ptr<const void> keep_alive;
+  std::function<void()> on_resident;
+
+  // image jobs only, pixels are staged in a PBO. level offsets are relative
+  // to data.
+  bool image = false;
+  GLenum bind_target = 0;
+  GLenum image_target = 0;
+  bool compressed = false;
+  GLenum internal_format = 0;
+  GLenum format = 0;
+  std::vector<texture_level_t> levels;
+  bool mipmap = false;
+  GLuint pbo = 0;
+
+  GLsync fence = 0;
+};
+
+inline std::vector<std::future<std::function<void()>>> decoding;
+inline std::deque<job_t> pending;
+inline std::vector<job_t> in_flight;
+
+// copies at most budget bytes of the job, returns the number copied
+inline size_t copy_slice(job_t &job, size_t budget) {
+  size_t n = std::min(budget, job.size - job.offset);
+  GLenum target = job.image ? GL_PIXEL_UNPACK_BUFFER : GL_COPY_WRITE_BUFFER;
+
+  if (job.image && job.pbo == 0) {
+    glGenBuffers(1, &job.pbo);
+    glBindBuffer(target, job.pbo);
+    glBufferData(target, job.size, nullptr, GL_STREAM_DRAW);
+  } else {
+    glBindBuffer(target, job.image ? job.pbo : job.object);
+  }
+
+  // the ranges are fresh storage nobody reads yet, no need to sync
+  void *dst = glMapBufferRange(target, job.base + job.offset, n,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                   GL_MAP_UNSYNCHRONIZED_BIT);
+  if (dst) {
+    std::memcpy(dst, job.data + job.offset, n);
+    glUnmapBuffer(target);
+  } else {
+    glBufferSubData(target, job.base + job.offset, n, job.data + job.offset);
+  }
+  job.offset += n;
+
+  if (job.image && job.offset == job.size) {
+    gl_state.bind_texture(job.bind_target, job.object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < job.levels.size(); i++) {
+      const texture_level_t &level = job.levels[i];
+      if (job.compressed) {
+        glCompressedTexImage2D(job.image_target, i, job.internal_format,
+                               level.width, level.height, 0, level.size,
+                               (void *)level.offset);
+      } else {
+        glTexImage2D(job.image_target, i, job.internal_format, level.width,
+                     level.height, 0, job.format, GL_UNSIGNED_BYTE,
+                     (void *)level.offset);
+      }
+    }
+    if (job.mipmap && !job.compressed) {
+      glGenerateMipmap(job.bind_target);
+    }
+  }
+
+  glBindBuffer(target, 0);
+  return n;
+}
+
+inline bool signaled(GLsync fence) {
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+} // namespace detail
+
+// runs work on the pool, the closure it returns runs on the GL thread
+inline void async(std::function<std::function<void()>()> work) {
+  detail::decoding.push_back(thread_pool().submit(std::move(work)));
+}
+
+// streams data into an already allocated buffer at buffer_offset, data must
+// stay valid until on_resident runs, keep_alive can hold its owner. the
+// range must be one nothing draws from yet.
+inline void upload_buffer(GLuint buffer, const void *data, size_t size,
+                          std::function<void()> on_resident,
+                          std::shared_ptr<const void> keep_alive = nullptr,
+                          size_t buffer_offset = 0) {
+  detail::job_t job;
+  job.object = buffer;
+  job.base = buffer_offset;
+  job.data = static_cast<const uint8_t *>(data);
+  job.size = size;
+  job.keep_alive = std::move(keep_alive);
+  job.on_resident = std::move(on_resident);
+  detail::pending.push_back(std::move(job));
+}
+
+// image_target is the cube face for cubemaps, bind_target otherwise. a
+// compressed mip chain is uploaded as is, plain images get their mips
+// generated.
+inline void upload_texture(GLuint texture, GLenum bind_target,
+                           GLenum image_target, const texture_data_t &data,
+                           bool gamma_correction, bool mipmap,
+                           std::function<void()> on_resident) {
+  detail::job_t job;
+  job.object = texture;
+  job.data = data.data;
+  job.keep_alive = data.storage;
+  job.on_resident = std::move(on_resident);
+  job.image = true;
+  job.bind_target = bind_target;
+  job.image_target = image_target;
+  job.compressed = data.compressed;
+  job.internal_format = data.upload_format(gamma_correction);
+  job.format = texture_format(data.channels, false).second;
+  job.levels = data.levels;
+  job.mipmap = mipmap;
+
+  // without mipmapping only the base level is needed
+  if (!mipmap) {
+    job.levels.resize(1);
+  }
+  job.size = job.levels.back().offset + job.levels.back().size;
+
+  detail::pending.push_back(std::move(job));
+}
+
+inline void upload_image(GLuint texture, GLenum bind_target,
+                         GLenum image_target, const image_t &image,
+                         bool gamma_correction, bool mipmap,
+                         std::function<void()> on_resident) {
+  upload_texture(texture, bind_target, image_target, texture_data(image),
+                 gamma_correction, mipmap, std::move(on_resident));
+}
+
+// decodes path on the pool, or maps its block compressed version when
+// compress is set, then streams it into texture. on_failed runs instead of
+// on_resident when the image cannot be read, on the GL thread as well.
+inline void load_image(GLuint texture, GLenum bind_target, GLenum image_target,
+                       const std::string &path, bool gamma_correction,
+                       bool mipmap, std::function<void()> on_resident,
+                       bool compress = false,
+                       std::function<void()> on_failed = nullptr) {
+  async([=]() -> std::function<void()> {
+    texture_data_t data =
+        compress ? load_compressed(path) : texture_data(decode_image(path));
+    if (!data.valid()) {
+      return [=]() {
+        LOG_ERR("failed to stream texture: %s", path.c_str());
+        if (on_failed) {
+          on_failed();
+        }
+      };
+    }
+    return [=]() {
+      upload_texture(texture, bind_target, image_target, data,
+                     gamma_correction, mipmap, on_resident);
+    };
+  });
+}
+
+inline bool idle() {
+  return detail::decoding.empty() && detail::pending.empty() &&
+         detail::in_flight.empty();
+}
+
+inline void update() {
+  using namespace detail;
+
+  // finished decodes hand their GL work over
+  for (size_t i = 0; i < decoding.size();) {
+    if (decoding[i].wait_for(std::chrono::seconds(0)) ==
+        std::future_status::ready) {
+      std::function<void()> finish = decoding[i].get();
+      decoding.erase(decoding.begin() + i);
+      if (finish) {
+        finish();
+      }
+    } else {
+      i++;
+    }
+  }
+
+  // uploads the GPU has consumed become resident
+  for (size_t i = 0; i < in_flight.size();) {
+    job_t &job = in_flight[i];
+    if (signaled(job.fence)) {
+      glDeleteSync(job.fence);
+      if (job.pbo) {
+        glDeleteBuffers(1, &job.pbo);
+      }
+      if (job.on_resident) {
+        job.on_resident();
+      }
+      in_flight.erase(in_flight.begin() + i);
+    } else {
+      i++;
+    }
+  }
+
+  size_t budget = frame_budget;
+  while (budget > 0 && !pending.empty()) {
+    job_t &job = pending.front();
+    if (job.offset < job.size) {
+      budget -= copy_slice(job, budget);
+    }
+    if (job.offset == job.size) {
+      job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      in_flight.push_back(std::move(job));
+      pending.pop_front();
+    }
+  }
+}
+
+} // namespace cs7gv3::common::streamer
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+namespace cs7gv3::common {
+
+// decoded pixels, safe to produce on any thread
+struct image_t {
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::shared_ptr<uint8_t> pixels;
+
+  bool valid() const { return pixels != nullptr; }
+  size_t size() const { return (size_t)width * height * channels; }
+};
+
+inline image_t decode_image(const std::string &path) {
+  image_t image;
+  uint8_t *data = stbi_load(path.c_str(), &image.width, &image.height,
+                            &image.channels, 0);
+  if (!data) {
+    LOG_ERR("texture failed to load at path: %s", path.c_str());
+    return image;
+  }
+
+  image.pixels = std::shared_ptr<uint8_t>(data, stbi_image_free);
+  return image;
+}
+
+// {internal format, pixel format} for an image with n channels
+inline std::pair<GLenum, GLenum> texture_format(int channels,
+                                                bool gamma_correction) {
+  switch (channels) {
+  case 1:
+    return {GL_RED, GL_RED};
+  case 4:
+    return {gamma_correction ? GL_SRGB_ALPHA : GL_RGBA, GL_RGBA};
+  default:
+    return {gamma_correction ? GL_SRGB : GL_RGB, GL_RGB};
+  }
+}
+
+inline void set_texture_params(GLenum target, bool mipmap) {
+  GLenum wrap = target == GL_TEXTURE_CUBE_MAP ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+  }
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                  mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+inline GLuint load_texture(const std::string &path,
+                           bool gamma_correction = false) {
+  image_t image = decode_image(path);
+  if (!image.valid()) {
+    return 0;
+  }
+
+  auto [internal_format, format] =
+      texture_format(image.channels, gamma_correction);
+
+  GLuint id = 0;
+  glGenTextures(1, &id);
+  gl_state.bind_texture(GL_TEXTURE_2D, id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.width, image.height, 0,
+               format, GL_UNSIGNED_BYTE, image.pixels.get());
+  glGenerateMipmap(GL_TEXTURE_2D);
+  set_texture_params(GL_TEXTURE_2D, true);
+
+  return id;
+}
+
+// 1x1 stand-in bound while the real texture is still streaming in
+inline GLuint placeholder_texture(GLenum target, uint8_t r, uint8_t g,
+                                  uint8_t b) {
+  static std::map<std::tuple<GLenum, uint8_t, uint8_t, uint8_t>, GLuint> cache;
+
+  auto &id = cache[{target, r, g, b}];
+  if (id != 0) {
+    return id;
+  }
+
+  const uint8_t pixel[] = {r, g, b};
+  glGenTextures(1, &id);
+  gl_state.bind_texture(target, id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    for (GLenum face = 0; face < 6; face++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, 1, 1, 0,
+                   GL_RGB, GL_UNSIGNED_BYTE, pixel);
+    }
+  } else {
+    glTexImage2D(target, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, pixel);
+  }
+  set_texture_params(target, false);
+
+  return id;
+}
+
+// a flat normal for normal maps, mid grey for everything else
+inline GLuint placeholder_texture(const std::string &type) {
+  if (type == "texture_normal") {
+    return placeholder_texture(GL_TEXTURE_2D, 128, 128, 255);
+  }
+  return placeholder_texture(GL_TEXTURE_2D, 128, 128, 128);
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,485 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "mapped_file.hpp"
+#include "texture.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// First-run transcode of textures into S3TC (BC1 for RGB, BC3 for RGBA)
+// with a full mip chain, cached as KTX 1.1 files and uploaded with
+// glCompressedTexImage2D. BC1 is 8:1 against RGBA8 and sampled straight from
+// the compressed blocks. BC7 and ETC2 are not available on the GL 4.1 core
+// profile macOS gives us, S3TC is.
+namespace cs7gv3::common {
+
+inline std::string texture_cache_dir = ".cache/texture";
+
+// from EXT_texture_compression_s3tc / EXT_texture_sRGB, not every loader
+// exports them
+constexpr GLenum compressed_rgb_bc1 = 0x83F0;
+constexpr GLenum compressed_rgba_bc3 = 0x83F3;
+constexpr GLenum compressed_srgb_bc1 = 0x8C4C;
+constexpr GLenum compressed_srgb_alpha_bc3 = 0x8C4F;
+
+struct texture_level_t {
+  int width;
+  int height;
+  size_t offset; // into texture_data_t::data
+  size_t size;
+};
+
+// pixels ready for upload, either one plain level or a compressed mip chain
+struct texture_data_t {
+  bool compressed = false;
+  GLenum internal_format = 0; // linear, see upload_format()
+  int channels = 0;           // uncompressed only
+  std::vector<texture_level_t> levels;
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  std::shared_ptr<const void> storage;
+
+  bool valid() const { return data != nullptr; }
+
+  // the format to hand to GL, sRGB variants share the block encoding
+  GLenum upload_format(bool srgb) const {
+    if (!compressed) {
+      return texture_format(channels, srgb).first;
+    }
+    if (!srgb) {
+      return internal_format;
+    }
+    return internal_format == compressed_rgb_bc1 ? compressed_srgb_bc1
+                                                 : compressed_srgb_alpha_bc3;
+  }
+};
+
+inline texture_data_t texture_data(const image_t &image) {
+  texture_data_t data;
+  data.channels = image.channels;
+  data.levels.push_back({image.width, image.height, 0, image.size()});
+  data.data = image.pixels.get();
+  data.size = image.size();
+  data.storage = image.pixels;
+  return data;
+}
+
+namespace detail {
+
+// RGBA8 working image
+struct rgba_image_t {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+
+  const uint8_t *at(int x, int y) const {
+    x = std::min(x, width - 1);
+    y = std::min(y, height - 1);
+    return &pixels[((size_t)y * width + x) * 4];
+  }
+};
+
+inline rgba_image_t to_rgba(const image_t &image) {
+  rgba_image_t out;
+  out.width = image.width;
+  out.height = image.height;
+  out.pixels.resize((size_t)image.width * image.height * 4);
+  const uint8_t *src = image.pixels.get();
+  for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+    const uint8_t *p = src + i * image.channels;
+    out.pixels[i * 4 + 0] = p[0];
+    out.pixels[i * 4 + 1] = image.channels > 1 ? p[1] : p[0];
+    out.pixels[i * 4 + 2] = image.channels > 2 ? p[2] : p[0];
+    out.pixels[i * 4 + 3] = image.channels > 3 ? p[3] : 255;
+  }
+  return out;
+}
+
+// 2x2 box filter, odd edges repeat the last texel
+inline rgba_image_t downsample(const rgba_image_t &src) {
+  rgba_image_t dst;
+  dst.width = std::max(1, src.width / 2);
+  dst.height = std::max(1, src.height / 2);
+  dst.pixels.resize((size_t)dst.width * dst.height * 4);
+  for (int y = 0; y < dst.height; y++) {
+    for (int x = 0; x < dst.width; x++) {
+      const uint8_t *a = src.at(x * 2, y * 2);
+      const uint8_t *b = src.at(x * 2 + 1, y * 2);
+      const uint8_t *c = src.at(x * 2, y * 2 + 1);
+      const uint8_t *d = src.at(x * 2 + 1, y * 2 + 1);
+      uint8_t *o = &dst.pixels[((size_t)y * dst.width + x) * 4];
+      for (int k = 0; k < 4; k++) {
+        o[k] = (a[k] + b[k] + c[k] + d[k] + 2) / 4;
+      }
+    }
+  }
+  return dst;
+}
+
+inline uint16_t pack_565(const float *c) {
+  auto q = [](float v, int max) {
+    return (uint16_t)std::clamp((int)(v / 255.0f * max + 0.5f), 0, max);
+  };
+  return (q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31);
+}
+
+inline void unpack_565(uint16_t v, int *c) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// endpoints from the extent of the block along its principal axis
+inline void encode_bc1_block(const uint8_t block[16][4], uint8_t *out) {
+  float mean[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int k = 0; k < 3; k++) {
+      mean[k] += block[i][k] / 16.0f;
+    }
+  }
+
+  float cov[6] = {0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    float r = block[i][0] - mean[0], g = block[i][1] - mean[1],
+          b = block[i][2] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+
+  float axis[3] = {1, 1, 1};
+  for (int iter = 0; iter < 4; iter++) {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float m = std::max({std::fabs(x), std::fabs(y), std::fabs(z)});
+    if (m == 0.0f) {
+      break;
+    }
+    axis[0] = x / m;
+    axis[1] = y / m;
+    axis[2] = z / m;
+  }
+
+  float lo = 1e9f, hi = -1e9f;
+  for (int i = 0; i < 16; i++) {
+    float t = (block[i][0] - mean[0]) * axis[0] +
+              (block[i][1] - mean[1]) * axis[1] +
+              (block[i][2] - mean[2]) * axis[2];
+    lo = std::min(lo, t);
+    hi = std::max(hi, t);
+  }
+
+  float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float c0[3], c1[3];
+  for (int k = 0; k < 3; k++) {
+    c0[k] = mean[k] + axis[k] * hi / (len2 > 0 ? len2 : 1);
+    c1[k] = mean[k] + axis[k] * lo / (len2 > 0 ? len2 : 1);
+  }
+
+  uint16_t e0 = pack_565(c0), e1 = pack_565(c1);
+  if (e0 < e1) {
+    std::swap(e0, e1);
+  }
+
+  uint32_t indices = 0;
+  if (e0 != e1) {
+    int p[4][3];
+    unpack_565(e0, p[0]);
+    unpack_565(e1, p[1]);
+    for (int k = 0; k < 3; k++) {
+      p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+      p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+    }
+
+    for (int i = 0; i < 16; i++) {
+      int best = 0, best_d = 1 << 30;
+      for (int j = 0; j < 4; j++) {
+        int dr = block[i][0] - p[j][0], dg = block[i][1] - p[j][1],
+            db = block[i][2] - p[j][2];
+        int d = dr * dr + dg * dg + db * db;
+        if (d < best_d) {
+          best_d = d;
+          best = j;
+        }
+      }
+      indices |= (uint32_t)best << (i * 2);
+    }
+  }
+
+  out[0] = e0 & 0xff;
+  out[1] = e0 >> 8;
+  out[2] = e1 & 0xff;
+  out[3] = e1 >> 8;
+  std::memcpy(out + 4, &indices, 4);
+}
+
+inline void encode_bc3_alpha_block(const uint8_t block[16][4], uint8_t *out) {
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    a0 = std::max<int>(a0, block[i][3]);
+    a1 = std::min<int>(a1, block[i][3]);
+  }
+
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    int p[8] = {a0, a1};
+    for (int j = 1; j < 7; j++) {
+      p[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+    }
+    for (int i = 0; i < 16; i++) {
+      int best = 0, best_d = 1 << 30;
+      for (int j = 0; j < 8; j++) {
+        int d = std::abs(block[i][3] - p[j]);
+        if (d < best_d) {
+          best_d = d;
+          best = j;
+        }
+      }
+      indices |= (uint64_t)best << (i * 3);
+    }
+  }
+
+  out[0] = a0;
+  out[1] = a1;
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = (indices >> (i * 8)) & 0xff;
+  }
+}
+
+inline void compress_level(const rgba_image_t &image, bool alpha,
+                           uint8_t *out) {
+  int bw = (image.width + 3) / 4, bh = (image.height + 3) / 4;
+  size_t block_size = alpha ? 16 : 8;
+
+  parallel_for(bh, [&](size_t by) {
+    uint8_t block[16][4];
+    for (int bx = 0; bx < bw; bx++) {
+      for (int i = 0; i < 16; i++) {
+        std::memcpy(block[i], image.at(bx * 4 + i % 4, (int)by * 4 + i / 4),
+                    4);
+      }
+      uint8_t *dst = out + ((size_t)by * bw + bx) * block_size;
+      if (alpha) {
+        encode_bc3_alpha_block(block, dst);
+        dst += 8;
+      }
+      encode_bc1_block(block, dst);
+    }
+  });
+}
+
+struct ktx_header_t {
+  uint8_t identifier[12];
+  uint32_t endianness;
+  uint32_t gl_type;
+  uint32_t gl_type_size;
+  uint32_t gl_format;
+  uint32_t gl_internal_format;
+  uint32_t gl_base_internal_format;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t number_of_array_elements;
+  uint32_t number_of_faces;
+  uint32_t number_of_mipmap_levels;
+  uint32_t bytes_of_key_value_data;
+};
+
+constexpr uint8_t ktx_identifier[12] = {0xAB, 'K',  'T',  'X', ' ',  '1',
+                                        '1',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+inline std::string texture_cache_path(const std::string &source,
+                                      uint64_t hash) {
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016" PRIx64, hash);
+  return texture_cache_dir + "/" +
+         std::filesystem::path(source).filename().string() + "-" + hex +
+         ".ktx";
+}
+
+// maps a KTX written by write_ktx(), 2d compressed textures only
+inline texture_data_t read_ktx(const std::string &path) {
+  texture_data_t data;
+  auto file = std::make_shared<mapped_file_t>(path);
+  if (!file->valid() || file->size() < sizeof(ktx_header_t)) {
+    return data;
+  }
+
+  auto header = reinterpret_cast<const ktx_header_t *>(file->data());
+  if (std::memcmp(header->identifier, ktx_identifier, 12) != 0 ||
+      header->endianness != 0x04030201 || header->gl_type != 0 ||
+      header->number_of_faces != 1 || header->number_of_mipmap_levels == 0) {
+    return data;
+  }
+
+  // levels are relative to the first, the header is never uploaded
+  size_t base = sizeof(ktx_header_t) + header->bytes_of_key_value_data;
+  size_t offset = base;
+  int width = header->pixel_width, height = header->pixel_height;
+  for (uint32_t i = 0; i < header->number_of_mipmap_levels; i++) {
+    if (offset + 4 > file->size()) {
+      return texture_data_t{};
+    }
+    uint32_t size;
+    std::memcpy(&size, file->data() + offset, 4);
+    offset += 4;
+    if (offset + size > file->size()) {
+      return texture_data_t{};
+    }
+    data.levels.push_back({width, height, offset - base, size});
+    offset += (size + 3) & ~3u;
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+
+  data.compressed = true;
+  data.internal_format = header->gl_internal_format;
+  data.data = file->data() + base;
+  data.size = file->size() - base;
+  data.storage = file;
+  return data;
+}
+
+inline bool write_ktx(const std::string &path, GLenum internal_format,
+                      GLenum base_format,
+                      const std::vector<std::vector<uint8_t>> &levels,
+                      int width, int height) {
+  ktx_header_t header{};
+  std::memcpy(header.identifier, ktx_identifier, 12);
+  header.endianness = 0x04030201;
+  header.gl_type_size = 1;
+  header.gl_internal_format = internal_format;
+  header.gl_base_internal_format = base_format;
+  header.pixel_width = width;
+  header.pixel_height = height;
+  header.number_of_faces = 1;
+  header.number_of_mipmap_levels = levels.size();
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+
+  // the cache path ignores the sampler, two entries of one image may write
+  // it at once from the pool
+  std::string tmp_path = temp_path(path);
+  FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+  if (!fp) {
+    LOG_ERR("failed to write texture cache: %s", tmp_path.c_str());
+    return false;
+  }
+
+  bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (const auto &level : levels) {
+    uint32_t size = level.size();
+    const uint8_t pad[3] = {0, 0, 0};
+    ok = ok && std::fwrite(&size, 4, 1, fp) == 1 &&
+         std::fwrite(level.data(), 1, size, fp) == size &&
+         std::fwrite(pad, 1, (4 - size % 4) % 4, fp) == (4 - size % 4) % 4;
+  }
+  ok = std::fclose(fp) == 0 && ok;
+
+  if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERR("failed to write texture cache: %s", path.c_str());
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace detail
+
+// the compressed, mipmapped version of an image file, transcoding and
+// caching it on first use. single channel images stay uncompressed. safe to
+// call from any thread.
+inline texture_data_t load_compressed(const std::string &path) {
+  using namespace detail;
+
+  uint64_t hash = 0;
+  {
+    mapped_file_t source(path);
+    if (!source.valid()) {
+      LOG_ERR("texture failed to load at path: %s", path.c_str());
+      return {};
+    }
+    hash = hash_bytes(source.data(), source.size());
+  }
+
+  std::string cache_path = texture_cache_path(path, hash);
+  texture_data_t cached = read_ktx(cache_path);
+  if (cached.valid()) {
+    return cached;
+  }
+
+  image_t image = decode_image(path);
+  if (!image.valid() || image.channels == 1) {
+    return image.valid() ? texture_data(image) : texture_data_t{};
+  }
+
+  bool alpha = image.channels == 4;
+  std::vector<std::vector<uint8_t>> levels;
+  rgba_image_t level = to_rgba(image);
+  while (true) {
+    size_t blocks = (size_t)((level.width + 3) / 4) * ((level.height + 3) / 4);
+    levels.emplace_back(blocks * (alpha ? 16 : 8));
+    compress_level(level, alpha, levels.back().data());
+    if (level.width == 1 && level.height == 1) {
+      break;
+    }
+    level = downsample(level);
+  }
+
+  GLenum internal_format = alpha ? compressed_rgba_bc3 : compressed_rgb_bc1;
+  if (write_ktx(cache_path, internal_format, alpha ? GL_RGBA : GL_RGB, levels,
+                image.width, image.height)) {
+    cached = read_ktx(cache_path);
+    if (cached.valid()) {
+      LOG_INFO("transcoded %s to %s", path.c_str(), cache_path.c_str());
+      return cached;
+    }
+  }
+
+  // could not cache, fall back to the plain pixels
+  return texture_data(image);
+}
+
+// GL thread only
+inline bool has_extension(const char *name) {
+  GLint n = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for (GLint i = 0; i < n; i++) {
+    auto ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (ext && std::strcmp(ext, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// S3TC is an extension on core profiles, GL thread only
+inline bool compressed_textures_supported() {
+  static bool supported = has_extension("GL_EXT_texture_compression_s3tc");
+  return supported;
+}
+
+// the sRGB S3TC formats come from a second extension, without it sRGB
+// textures stay uncompressed
+inline bool compressed_srgb_textures_supported() {
+  static bool supported =
+      compressed_textures_supported() && has_extension("GL_EXT_texture_sRGB");
+  return supported;
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "streamer.hpp"
+#include "texture.hpp"
+#include "texture_compress.hpp"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace cs7gv3::common {
+
+struct sampler_t {
+  GLenum wrap = GL_REPEAT;
+  GLenum min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  GLenum mag_filter = GL_LINEAR;
+  bool srgb = false;
+  // block compressed when the driver can sample it
+  bool compress = true;
+
+  bool mipmap() const {
+    return min_filter != GL_LINEAR && min_filter != GL_NEAREST;
+  }
+
+  bool operator<(const sampler_t &o) const {
+    return std::tie(wrap, min_filter, mag_filter, srgb, compress) <
+           std::tie(o.wrap, o.min_filter, o.mag_filter, o.srgb, o.compress);
+  }
+};
+
+constexpr sampler_t cubemap_sampler = {GL_CLAMP_TO_EDGE, GL_LINEAR, GL_LINEAR,
+                                       false, true};
+
+// one GL texture shared by everybody who asked for the same files with the
+// same sampler, deleted when the last reference goes away.
+class shared_texture_t {
+public:
+  GLenum target = GL_TEXTURE_2D;
+  GLuint id = 0;
+  GLuint placeholder = 0;
+  size_t pending = 0; // images still streaming in
+  bool failed = false; // an image could not be read, placeholder for good
+
+  shared_texture_t() = default;
+  shared_texture_t(const shared_texture_t &) = delete;
+  shared_texture_t &operator=(const shared_texture_t &) = delete;
+
+  ~shared_texture_t() {
+    // globals may outlive the context
+    if (id != 0 && glfwGetCurrentContext()) {
+      gl_state.delete_textures(1, &id);
+    }
+  }
+
+  bool resident() const { return pending == 0; }
+  GLuint bind_id() const { return resident() && !failed ? id : placeholder; }
+};
+
+using texture_ref_t = std::shared_ptr<shared_texture_t>;
+
+// GL thread only, like the streamer it feeds.
+namespace texture_registry {
+
+namespace detail {
+
+using key_t = std::tuple<GLenum, std::vector<std::string>, sampler_t>;
+
+inline std::map<key_t, std::weak_ptr<shared_texture_t>> textures;
+
+inline void apply(GLenum target, const sampler_t &sampler) {
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, sampler.wrap);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, sampler.wrap);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, sampler.wrap);
+  }
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, sampler.min_filter);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, sampler.mag_filter);
+}
+
+} // namespace detail
+
+// paths holds one file for 2d textures and the six faces, +x first, for
+// cubemaps. placeholder is bound until every image is resident.
+inline texture_ref_t load(GLenum target, const std::vector<std::string> &paths,
+                          const sampler_t &sampler, GLuint placeholder) {
+  detail::key_t key{target, paths, sampler};
+  auto it = detail::textures.find(key);
+  if (it != detail::textures.end()) {
+    if (texture_ref_t texture = it->second.lock()) {
+      return texture;
+    }
+  }
+
+  // the deleter drops the map entry with the texture, but only if the entry
+  // was not replaced in the meantime
+  auto release = [key](shared_texture_t *t) {
+    auto it = detail::textures.find(key);
+    if (it != detail::textures.end() && it->second.expired()) {
+      detail::textures.erase(it);
+    }
+    delete t;
+  };
+  texture_ref_t texture(new shared_texture_t, release);
+  texture->target = target;
+  texture->placeholder = placeholder;
+  texture->pending = paths.size();
+
+  glGenTextures(1, &texture->id);
+  gl_state.bind_texture(target, texture->id);
+  detail::apply(target, sampler);
+
+  // the callbacks hold the texture until its jobs are done, so its name
+  // cannot be deleted, and reused, under an upload still in the queue
+  bool compress =
+      sampler.compress && (sampler.srgb ? compressed_srgb_textures_supported()
+                                        : compressed_textures_supported());
+  for (size_t i = 0; i < paths.size(); i++) {
+    GLenum image_target =
+        target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+                                      : target;
+    streamer::load_image(
+        texture->id, target, image_target, paths[i], sampler.srgb,
+        sampler.mipmap(), [texture]() { texture->pending--; }, compress,
+        [texture]() {
+          texture->failed = true;
+          texture->pending--;
+        });
+  }
+
+  detail::textures[key] = texture;
+  return texture;
+}
+
+inline texture_ref_t load_2d(const std::string &path, const sampler_t &sampler,
+                             GLuint placeholder) {
+  return load(GL_TEXTURE_2D, {path}, sampler, placeholder);
+}
+
+inline texture_ref_t load_cubemap(const std::vector<std::string> &faces,
+                                  const sampler_t &sampler = cubemap_sampler) {
+  return load(GL_TEXTURE_CUBE_MAP, faces, sampler,
+              placeholder_texture(GL_TEXTURE_CUBE_MAP, 128, 128, 128));
+}
+
+inline size_t size() { return detail::textures.size(); }
+
+} // namespace texture_registry
+
+} // namespace cs7gv3::common
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace cs7gv3::common {
+
+class thread_pool_t {
+public:
+  explicit thread_pool_t(
+      size_t n = std::max(1u, std::thread::hardware_concurrency())) {
+    for (size_t i = 0; i < n; i++) {
+      _workers.emplace_back([this]() { worker(); });
+    }
+  }
+
+  ~thread_pool_t() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    for (auto &t : _workers) {
+      t.join();
+    }
+  }
+
+  thread_pool_t(const thread_pool_t &) = delete;
+  thread_pool_t &operator=(const thread_pool_t &) = delete;
+
+  size_t size() const { return _workers.size(); }
+
+  template <typename F> auto submit(F &&f) -> std::future<decltype(f())> {
+    using result_t = decltype(f());
+    auto task =
+        std::make_shared<std::packaged_task<result_t()>>(std::forward<F>(f));
+    std::future<result_t> future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _tasks.emplace([task]() { (*task)(); });
+    }
+    _cv.notify_one();
+    return future;
+  }
+
+private:
+  std::vector<std::thread> _workers;
+  std::queue<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  bool _stop = false;
+
+  void worker() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+        if (_stop && _tasks.empty()) {
+          return;
+        }
+        task = std::move(_tasks.front());
+        _tasks.pop();
+      }
+      task();
+    }
+  }
+};
+
+inline thread_pool_t &thread_pool() {
+  static thread_pool_t pool;
+  return pool;
+}
+
+// runs fn(0) .. fn(n - 1) on the pool. The calling thread takes items too and
+// only waits for items somebody already started, so it is safe to call from
+// inside a pool task.
+inline void parallel_for(size_t n, const std::function<void(size_t)> &fn) {
+  if (n == 0) {
+    return;
+  }
+  if (n == 1) {
+    fn(0);
+    return;
+  }
+
+  struct state_t {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<state_t>();
+  const size_t total = n;
+
+  auto run = [state, &fn, total]() {
+    size_t i;
+    while ((i = state->next.fetch_add(1)) < total) {
+      fn(i);
+      if (state->done.fetch_add(1) + 1 == total) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->cv.notify_all();
+      }
+    }
+  };
+
+  size_t helpers = std::min(n - 1, thread_pool().size());
+  for (size_t i = 0; i < helpers; i++) {
+    thread_pool().submit(run);
+  }
+  run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&]() { return state->done.load() == total; });
+}
+
+} // namespace cs7gv3::common
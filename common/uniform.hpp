@@ -0,0 +1,253 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "gl_state.hpp"
+#include "uniform_block.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Uniform handles: names are hashed at compile time, every program gets a
+// flat table of hash -> location the first time it is used, and setting a
+// uniform the program does not have is a lookup miss, no GL call. The table
+// also shadows the last value written to each location, uniforms are state
+// of the program so setting the same value again is dropped as well.
+//
+//   constexpr common::uniform_t light_position = "light.position";
+//   common::current_uniforms().set(light_position, light.position);
+namespace cs7gv3::common {
+
+// FNV-1a over the name, extendable so array elements need no string
+struct uniform_t {
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  constexpr uniform_t() = default;
+  constexpr uniform_t(const char *name) { *this = append(name); }
+  constexpr uniform_t(std::string_view name) { *this = append(name); }
+
+  constexpr uniform_t append(std::string_view s) const {
+    uniform_t u = *this;
+    for (char c : s) {
+      u.hash = (u.hash ^ (uint8_t)c) * 0x100000001b3ull;
+    }
+    return u;
+  }
+
+  // decimal, for names like light[3].position or texture_diffuse1
+  constexpr uniform_t append(size_t n) const {
+    char digits[20] = {};
+    size_t len = 0;
+    do {
+      digits[len++] = '0' + n % 10;
+      n /= 10;
+    } while (n > 0);
+
+    uniform_t u = *this;
+    while (len > 0) {
+      u.hash = (u.hash ^ (uint8_t)digits[--len]) * 0x100000001b3ull;
+    }
+    return u;
+  }
+
+  // element i of an array, member may be empty or start with '.'
+  constexpr uniform_t at(size_t i, std::string_view member = "") const {
+    return append("[").append(i).append("]").append(member);
+  }
+
+  constexpr bool operator==(const uniform_t &o) const { return hash == o.hash; }
+};
+
+namespace detail {
+
+inline void upload(GLint l, bool v) { glUniform1i(l, v); }
+inline void upload(GLint l, int v) { glUniform1i(l, v); }
+inline void upload(GLint l, float v) { glUniform1f(l, v); }
+inline void upload(GLint l, const glm::vec2 &v) { glUniform2fv(l, 1, &v[0]); }
+inline void upload(GLint l, const glm::vec3 &v) { glUniform3fv(l, 1, &v[0]); }
+inline void upload(GLint l, const glm::vec4 &v) { glUniform4fv(l, 1, &v[0]); }
+inline void upload(GLint l, const glm::ivec3 &v) { glUniform3iv(l, 1, &v[0]); }
+inline void upload(GLint l, const glm::mat3 &v) {
+  glUniformMatrix3fv(l, 1, GL_FALSE, &v[0][0]);
+}
+inline void upload(GLint l, const glm::mat4 &v) {
+  glUniformMatrix4fv(l, 1, GL_FALSE, &v[0][0]);
+}
+
+} // namespace detail
+
+// glUniform calls made and dropped as redundant. end_frame() moves the
+// running counts into the last_* ones the consoles show.
+struct uniform_stats_t {
+  size_t issued = 0;
+  size_t skipped = 0;
+  size_t last_issued = 0;
+  size_t last_skipped = 0;
+
+  void end_frame() {
+    last_issued = issued;
+    last_skipped = skipped;
+    issued = skipped = 0;
+  }
+};
+
+inline uniform_stats_t uniform_stats;
+
+class uniform_table_t {
+public:
+  uniform_table_t() = default;
+
+  // reads every active uniform of a linked program, array elements are
+  // listed one by one and the bare array name aliases element 0
+  explicit uniform_table_t(GLuint program) {
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::vector<char> buffer(std::max(max_length, 1));
+    for (GLint i = 0; i < count; i++) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program, i, buffer.size(), &length, &size, &type,
+                         buffer.data());
+      std::string name(buffer.data(), length);
+
+      std::string_view view(name);
+      if (view.size() > 3 && view.substr(view.size() - 3) == "[0]") {
+        std::string base = name.substr(0, name.size() - 3);
+        add(uniform_t(base), glGetUniformLocation(program, name.c_str()));
+        for (GLint k = 0; k < size; k++) {
+          std::string element = base + "[" + std::to_string(k) + "]";
+          add(uniform_t(element),
+              glGetUniformLocation(program, element.c_str()));
+        }
+      } else {
+        add(uniform_t(name), glGetUniformLocation(program, name.c_str()));
+      }
+    }
+
+    std::sort(
+        _locations.begin(), _locations.end(),
+        [](const entry_t &a, const entry_t &b) { return a.hash < b.hash; });
+    auto dup = std::adjacent_find(
+        _locations.begin(), _locations.end(),
+        [](const entry_t &a, const entry_t &b) { return a.hash == b.hash; });
+    if (dup != _locations.end()) {
+      LOG_ERR("uniform name hash collision in program %u", program);
+    }
+
+    // an array name and its element 0 share a location, and its shadow
+    std::unordered_map<GLint, uint32_t> shadows;
+    for (entry_t &e : _locations) {
+      e.shadow = shadows.emplace(e.location, shadows.size()).first->second;
+    }
+    _shadows.resize(shadows.size());
+
+    bind_block(program, "frame_block", frame_block_binding);
+    bind_block(program, "light_block", light_block_binding);
+    bind_block(program, "material_block", material_block_binding);
+  }
+
+  // -1 when the program has no such uniform
+  GLint location(uniform_t u) const {
+    const entry_t *e = find(u);
+    return e ? e->location : -1;
+  }
+
+  bool has(uniform_t u) const { return find(u) != nullptr; }
+
+  // the program must be in use. a value equal to the last one set through
+  // this table is not uploaded again.
+  template <typename T> void set(uniform_t u, const T &value) const {
+    static_assert(sizeof(T) <= sizeof(shadow_t::bytes),
+                  "uniform value larger than its shadow");
+    const entry_t *e = find(u);
+    if (!e) {
+      return;
+    }
+
+    shadow_t &shadow = _shadows[e->shadow];
+    if (shadow.size == sizeof(T) &&
+        std::memcmp(shadow.bytes, &value, sizeof(T)) == 0) {
+      uniform_stats.skipped++;
+      return;
+    }
+    std::memcpy(shadow.bytes, &value, sizeof(T));
+    shadow.size = sizeof(T);
+    detail::upload(e->location, value);
+    uniform_stats.issued++;
+  }
+
+  size_t size() const { return _locations.size(); }
+
+private:
+  struct entry_t {
+    uint64_t hash;
+    GLint location;
+    uint32_t shadow;
+  };
+
+  // big enough for a mat4
+  struct shadow_t {
+    uint8_t bytes[64];
+    uint8_t size = 0;
+  };
+
+  std::vector<entry_t> _locations;
+  mutable std::vector<shadow_t> _shadows;
+
+  const entry_t *find(uniform_t u) const {
+    auto it = std::lower_bound(
+        _locations.begin(), _locations.end(), u.hash,
+        [](const entry_t &e, uint64_t h) { return e.hash < h; });
+    return it != _locations.end() && it->hash == u.hash ? &*it : nullptr;
+  }
+
+  void add(uniform_t u, GLint location) {
+    // uniform block members have no location
+    if (location >= 0) {
+      _locations.push_back({u.hash, location, 0});
+    }
+  }
+
+  static void bind_block(GLuint program, const char *name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(program, index, binding);
+    }
+  }
+};
+
+namespace detail {
+
+inline std::unordered_map<GLuint, uniform_table_t> uniform_tables;
+
+} // namespace detail
+
+// the table of a linked program, resolved on first use. GL thread only.
+inline const uniform_table_t &uniforms(GLuint program) {
+  auto it = detail::uniform_tables.find(program);
+  if (it == detail::uniform_tables.end()) {
+    it = detail::uniform_tables.emplace(program, uniform_table_t(program))
+             .first;
+  }
+  return it->second;
+}
+
+// the table of the program in use
+inline const uniform_table_t &current_uniforms() {
+  return uniforms(gl_state.program());
+}
+
+// drop a table when its program is deleted or relinked
+inline void forget_uniforms(GLuint program) {
+  detail::uniform_tables.erase(program);
+}
+
+} // namespace cs7gv3::common
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "figine/figine.hpp"
+#include "projection.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// std140 uniform blocks shared by the lighting shaders. Every block lives in
+// one buffer with a slot per owner, so switching objects is a single
+// glBindBufferRange instead of a glUniform call per field:
+//   frame:    camera and time, written once per frame by update_frame()
+//   light:    the light set of an object
+//   material: the surface parameters of an object
+// uniform_table_t binds the blocks of a program to these points when the
+// program is first resolved.
+namespace cs7gv3::common {
+
+constexpr GLuint frame_block_binding = 0;
+constexpr GLuint light_block_binding = 1;
+constexpr GLuint material_block_binding = 2;
+
+// a vec3 followed by a float shares one 16 byte slot in std140, so the
+// structs pad every lone vec3 by hand. there is no implicit padding, the
+// blocks are compared bytewise.
+struct frame_block_t {
+  glm::mat4 view = glm::mat4(1.0f);
+  glm::mat4 projection = glm::mat4(1.0f);
+  glm::vec3 view_pos = glm::vec3(0.0f);
+  float time = 0.0f;
+};
+
+struct light_block_t {
+  glm::vec3 position = glm::vec3(0.0f);
+  float _pad0 = 0.0f;
+  glm::vec3 ambient_color = glm::vec3(0.0f);
+  float _pad1 = 0.0f;
+  glm::vec3 diffuse_color = glm::vec3(0.0f);
+  float _pad2 = 0.0f;
+  glm::vec3 specular_color = glm::vec3(0.0f);
+  float _pad3 = 0.0f;
+};
+
+// phong terms plus the cook-torrance ones in the gaps
+struct material_block_t {
+  glm::vec3 ambient_color = glm::vec3(0.0f);
+  float shininess = 0.0f;
+  glm::vec3 diffuse_color = glm::vec3(0.0f);
+  float metallic = 0.0f;
+  glm::vec3 specular_color = glm::vec3(0.0f);
+  float roughness = 0.0f;
+  glm::vec3 albedo = glm::vec3(0.0f);
+  float ao = 0.0f;
+};
+
+static_assert(offsetof(frame_block_t, view_pos) == 128 &&
+                  offsetof(frame_block_t, time) == 140,
+              "frame_block_t must match its std140 layout");
+static_assert(sizeof(light_block_t) == 64,
+              "light_block_t must match its std140 layout");
+static_assert(offsetof(material_block_t, shininess) == 12 &&
+                  sizeof(material_block_t) == 64,
+              "material_block_t must match its std140 layout");
+
+// splice into a shader after #version. the frame block has no instance
+// name, its members read like the plain uniforms they replace.
+#define CS7GV3_FRAME_BLOCK_GLSL                                                \
+  "layout(std140) uniform frame_block {\n"                                     \
+  "  mat4 view;\n"                                                             \
+  "  mat4 projection;\n"                                                       \
+  "  vec3 view_pos;\n"                                                         \
+  "  float time;\n"                                                            \
+  "};\n"
+
+#define CS7GV3_LIGHT_BLOCK_GLSL                                                \
+  "layout(std140) uniform light_block {\n"                                     \
+  "  vec3 position;\n"                                                         \
+  "  vec3 ambient_color;\n"                                                    \
+  "  vec3 diffuse_color;\n"                                                    \
+  "  vec3 specular_color;\n"                                                   \
+  "} light;\n"
+
+#define CS7GV3_MATERIAL_BLOCK_GLSL                                             \
+  "layout(std140) uniform material_block {\n"                                  \
+  "  vec3 ambient_color;\n"                                                    \
+  "  float shininess;\n"                                                       \
+  "  vec3 diffuse_color;\n"                                                    \
+  "  float metallic;\n"                                                        \
+  "  vec3 specular_color;\n"                                                   \
+  "  float roughness;\n"                                                       \
+  "  vec3 albedo;\n"                                                           \
+  "  float ao;\n"                                                              \
+  "} material;\n"
+
+inline light_block_t
+light_block(const figine::builtin::shader::light_t &light) {
+  light_block_t block;
+  block.position = light.position;
+  block.ambient_color = light.ambient_color;
+  block.diffuse_color = light.diffuse_color;
+  block.specular_color = light.specular_color;
+  return block;
+}
+
+inline material_block_t
+material_block(const figine::builtin::shader::material_t &material) {
+  material_block_t block;
+  block.shininess = material.shininess;
+  block.ambient_color = material.ambient_color;
+  block.diffuse_color = material.diffuse_color;
+  block.specular_color = material.specular_color;
+  return block;
+}
+
+// one uniform buffer of T blocks at the alignment the driver asks for.
+// update() keeps a CPU copy and only writes blocks that changed. GL thread
+// only, the buffer is created on first use.
+template <typename T> class uniform_block_t {
+public:
+  explicit uniform_block_t(GLuint binding) : _binding(binding) {}
+
+  ~uniform_block_t() {
+    // the blocks below are globals, destroyed after the context
+    if (_ubo && glfwGetCurrentContext()) {
+      glDeleteBuffers(1, &_ubo);
+    }
+  }
+
+  uniform_block_t(const uniform_block_t &) = delete;
+  uniform_block_t &operator=(const uniform_block_t &) = delete;
+
+  // a new default block, the slot stays valid for the life of the buffer
+  size_t allocate() {
+    _blocks.emplace_back();
+    return _blocks.size() - 1;
+  }
+
+  void update(size_t slot, const T &value) {
+    reserve();
+    if (std::memcmp(&_blocks[slot], &value, sizeof(T)) == 0) {
+      return;
+    }
+    _blocks[slot] = value;
+    glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, slot * _stride, sizeof(T), &value);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  void bind(size_t slot) {
+    reserve();
+    glBindBufferRange(GL_UNIFORM_BUFFER, _binding, _ubo, slot * _stride,
+                      sizeof(T));
+  }
+
+  const T &operator[](size_t slot) const { return _blocks[slot]; }
+  size_t size() const { return _blocks.size(); }
+
+private:
+  GLuint _binding;
+  GLuint _ubo = 0;
+  size_t _stride = 0;
+  size_t _capacity = 0;
+  std::vector<T> _blocks;
+
+  // grows the buffer to hold every allocated slot, a new buffer gets the
+  // CPU copies of the old one
+  void reserve() {
+    if (_stride == 0) {
+      GLint alignment = 256;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      _stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+      glGenBuffers(1, &_ubo);
+    }
+    if (_capacity >= _blocks.size()) {
+      return;
+    }
+
+    _capacity = std::max<size_t>({_blocks.size(), _capacity * 2, 4});
+    std::vector<uint8_t> staging(_capacity * _stride, 0);
+    for (size_t i = 0; i < _blocks.size(); i++) {
+      std::memcpy(&staging[i * _stride], &_blocks[i], sizeof(T));
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+    glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(),
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+};
+
+inline uniform_block_t<frame_block_t> frame_blocks{frame_block_binding};
+inline uniform_block_t<light_block_t> light_blocks{light_block_binding};
+inline uniform_block_t<material_block_t>
+    material_blocks{material_block_binding};
+
+// writes and binds the frame block, call once per frame before drawing
+inline void update_frame(const figine::core::camera_t &camera, float time) {
+  static const size_t slot = frame_blocks.allocate();
+
+  frame_block_t frame;
+  frame.view = camera.view_matrix();
+  frame.projection = projection_matrix(camera);
+  frame.view_pos = camera.position;
+  frame.time = time;
+  frame_blocks.update(slot, frame);
+  frame_blocks.bind(slot);
+}
+
+} // namespace cs7gv3::common
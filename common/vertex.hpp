@@ -0,0 +1,34 @@
+#pragma once
+
+#include "figine/figine.hpp"
+
+#include <cstddef>
+
+namespace cs7gv3::common {
+
+// same layout object_t feeds to the shaders: locations 0..4 are position,
+// normal, texture coordinate, tangent and bitangent.
+struct vertex_t {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texture_coordinate;
+  glm::vec3 tangent;
+  glm::vec3 bitangent;
+};
+
+static_assert(sizeof(vertex_t) == 56, "vertex_t must stay tightly packed");
+
+// non-owning view, the storage usually is a mapped cache file.
+template <typename T> struct array_view_t {
+  const T *ptr = nullptr;
+  size_t count = 0;
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T *data() const { return ptr; }
+  const T *begin() const { return ptr; }
+  const T *end() const { return ptr + count; }
+  const T &operator[](size_t i) const { return ptr[i]; }
+};
+
+} // namespace cs7gv3::common
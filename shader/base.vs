@@ -8,14 +8,16 @@ out vec3 frag_pos;
 out vec3 normal;
 out vec2 texture_coordinate;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// set by model_t::apply_uniform(), normal_matrix is the inverse transpose
+// of transform
+uniform mat4 transform;
+uniform mat4 mvp;
+uniform mat3 normal_matrix;
 
 void main() {
     texture_coordinate = texture_coordinate_in;
-    frag_pos = vec3(model * vec4(pos_in, 1.0));
-    normal = mat3(transpose(inverse(model))) * normal_in;
+    frag_pos = vec3(transform * vec4(pos_in, 1.0));
+    normal = normal_matrix * normal_in;
 
-    gl_Position = projection * view * vec4(frag_pos, 1.0);
+    gl_Position = mvp * vec4(pos_in, 1.0);
 }
\ No newline at end of file
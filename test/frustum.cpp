@@ -0,0 +1,90 @@
+#include "common/frustum.hpp"
+#include "test.hpp"
+
+#include <random>
+
+using namespace cs7gv3;
+
+// the planes of clip space, w + x >= 0 and so on, inside is positive
+static float clip_plane(const glm::vec4 &clip, int k) {
+  float s = k % 2 ? -1.0f : 1.0f;
+  return clip.w + s * clip[k / 2];
+}
+
+int main() {
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  size_t boxes = 0, spheres = 0, culled = 0;
+  for (int v = 0; v < 20; v++) {
+    glm::vec3 eye(unit(rng) * 10.0f, unit(rng) * 10.0f, unit(rng) * 10.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(unit(rng), unit(rng), 0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(
+        glm::radians(30.0f + 60.0f * (unit(rng) * 0.5f + 0.5f)), 16.0f / 9.0f,
+        0.1f, 50.0f);
+    glm::mat4 vp = projection * view;
+    common::frustum_t frustum(vp);
+
+    for (int k = 0; k < 2000; k++) {
+      glm::vec3 center(unit(rng) * 30.0f, unit(rng) * 30.0f,
+                       unit(rng) * 30.0f);
+      glm::vec3 extent(std::abs(unit(rng)) * 4.0f, std::abs(unit(rng)) * 4.0f,
+                       std::abs(unit(rng)) * 4.0f);
+
+      // the box is outside when all eight corners are behind one plane.
+      // corners within a margin of a plane may go either way.
+      bool outside = false, close = false;
+      for (int p = 0; p < 6; p++) {
+        float furthest = -INFINITY;
+        for (int c = 0; c < 8; c++) {
+          glm::vec3 corner = center + glm::vec3(c & 1 ? extent.x : -extent.x,
+                                                c & 2 ? extent.y : -extent.y,
+                                                c & 4 ? extent.z : -extent.z);
+          float d = clip_plane(vp * glm::vec4(corner, 1.0f), p);
+          furthest = std::max(furthest, d);
+        }
+        outside |= furthest < 0.0f;
+        close |= std::abs(furthest) < 1e-3f;
+      }
+      if (!close) {
+        CHECK(frustum.box_visible(center, extent) == !outside);
+        boxes++;
+        culled += outside;
+      }
+
+      // and the sphere when its centre is further than radius behind one,
+      // measured along the plane's unit normal
+      float radius = std::abs(unit(rng)) * 4.0f;
+      outside = close = false;
+      for (int p = 0; p < 6; p++) {
+        glm::vec4 plane(clip_plane(glm::vec4(vp[0]), p),
+                        clip_plane(glm::vec4(vp[1]), p),
+                        clip_plane(glm::vec4(vp[2]), p),
+                        clip_plane(glm::vec4(vp[3]), p));
+        float d = (glm::dot(glm::vec3(plane), center) + plane.w) /
+                  glm::length(glm::vec3(plane));
+        outside |= d < -radius;
+        close |= std::abs(d + radius) < 1e-3f;
+      }
+      if (!close) {
+        CHECK(frustum.sphere_visible(center, radius) == !outside);
+        spheres++;
+      }
+    }
+  }
+  CHECK(culled > 0 && culled < boxes);
+  CHECK(spheres > 0);
+
+  // straight ahead is in, behind the camera and past the far plane are not
+  glm::mat4 vp = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 50.0f) *
+                 glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f),
+                             glm::vec3(0.0f, 1.0f, 0.0f));
+  common::frustum_t frustum(vp);
+  CHECK(frustum.visible({glm::vec3(-1.0f), glm::vec3(1.0f), 1.8f}));
+  CHECK(!frustum.visible({glm::vec3(-1.0f, -1.0f, 7.0f),
+                          glm::vec3(1.0f, 1.0f, 9.0f), 1.8f}));
+  CHECK(!frustum.visible({glm::vec3(-1.0f, -1.0f, -60.0f),
+                          glm::vec3(1.0f, 1.0f, -58.0f), 1.8f}));
+  return test::result();
+}
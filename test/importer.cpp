@@ -0,0 +1,130 @@
+#include "common/importer.hpp"
+#include "test.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace cs7gv3;
+
+static std::string write_file(const std::string &name,
+                              const std::string &text) {
+  std::string path =
+      (std::filesystem::temp_directory_path() / ("cs7gv3_" + name)).string();
+  std::ofstream(path, std::ios::binary) << text;
+  return path;
+}
+
+// the positions of every triangle, in order
+static std::vector<glm::vec3> triangles(const common::mesh_data_t &mesh) {
+  std::vector<glm::vec3> corners;
+  for (uint32_t i : mesh.indices) {
+    corners.push_back(mesh.vertices[i].position);
+  }
+  return corners;
+}
+
+static glm::vec3 at(int x, int y) { return glm::vec3(x, y, 0); }
+
+// a grid of quads large enough to be split into several chunks. every other
+// row refers to its vertices relative to the end, which the chunk holding the
+// row has to rebase. with materials, every group of rows uses its own and
+// becomes its own mesh.
+static std::string grid_obj(int n, int rows_per_material,
+                            std::vector<std::vector<glm::vec3>> &expected) {
+  std::string obj = rows_per_material ? "mtllib cs7gv3_grid.mtl\n" : "";
+  expected.assign(1, {});
+  for (int y = 0; y <= n; y++) {
+    for (int x = 0; x <= n; x++) {
+      obj += "v " + std::to_string(x) + " " + std::to_string(y) + " 0\n";
+    }
+    if (y == 0) {
+      continue;
+    }
+    if (rows_per_material && (y - 1) % rows_per_material == 0) {
+      obj += "usemtl m" + std::to_string((y - 1) / rows_per_material) + "\n";
+      if (y > 1) {
+        expected.emplace_back();
+      }
+    }
+    int row = (y - 1) * (n + 1) + 1, count = (y + 1) * (n + 1);
+    for (int x = 0; x < n; x++) {
+      int a = row + x, b = a + 1, c = b + n + 1, d = a + n + 1;
+      if (y % 2) {
+        a -= count + 1, b -= count + 1, c -= count + 1, d -= count + 1;
+      }
+      obj += "f " + std::to_string(a) + " " + std::to_string(b) + " " +
+             std::to_string(c) + " " + std::to_string(d) + "\n";
+      for (glm::vec3 p : {at(x, y - 1), at(x + 1, y - 1), at(x + 1, y),
+                          at(x, y - 1), at(x + 1, y), at(x, y)}) {
+        expected.back().push_back(p);
+      }
+    }
+  }
+  return obj;
+}
+
+int main() {
+  constexpr int n = 200;
+  std::vector<std::vector<glm::vec3>> expected;
+  std::string obj = grid_obj(n, 0, expected);
+  CHECK(obj.size() > 4 * common::detail::parallel_min_chunk);
+  auto meshes = common::import_obj(write_file("materials.obj", obj));
+  CHECK(meshes.size() == 1);
+  if (!meshes.empty()) {
+    CHECK(meshes[0].vertices.size() == (n + 1) * (n + 1));
+    CHECK(triangles(meshes[0]) == expected[0]);
+  }
+
+  // material groups cross the chunk boundaries, the vertices a group shares
+  // with itself across one must still be welded
+  std::string mtl;
+  for (int i = 0; i < 8; i++) {
+    mtl += "newmtl m" + std::to_string(i) + "\nmap_Kd m" + std::to_string(i) +
+           ".png\n";
+  }
+  write_file("grid.mtl", mtl);
+  obj = grid_obj(n, n / 8, expected);
+  meshes = common::import_obj(write_file("materials.obj", obj));
+  CHECK(meshes.size() == 8);
+  for (size_t i = 0; i < std::min<size_t>(meshes.size(), 8); i++) {
+    CHECK(meshes[i].material.diffuse_map == "m" + std::to_string(i) + ".png");
+    CHECK(meshes[i].vertices.size() == (n / 8 + 1) * (n + 1));
+    CHECK(triangles(meshes[i]) == expected[i]);
+  }
+
+  // a corner that does not exist ends the fan, the next one starts anew
+  meshes = common::import_obj(write_file("fan.obj", "v 0 0 0\nv 1 0 0\n"
+                                                    "v 1 1 0\nv 0 1 0\n"
+                                                    "v 2 0 0\nv 2 1 0\n"
+                                                    "f 1 2 3 9 2 5 6 3\n"));
+  CHECK(meshes.size() == 1);
+  if (!meshes.empty()) {
+    CHECK(triangles(meshes[0]) ==
+          std::vector<glm::vec3>({at(0, 0), at(1, 0), at(1, 1), at(1, 0),
+                                  at(2, 0), at(2, 1), at(1, 0), at(2, 1),
+                                  at(1, 1)}));
+  }
+
+  // OFF, a quad and a triangle with comments between the records
+  std::string off = "OFF\n# a comment\n5 2 0\n0 0 0\n1 0 0\n1 1 0\n0 1 0\n"
+                    "2 0 0\n4 0 1 2 3\n# another\n3 1 4 2\n";
+  meshes = common::import_off(write_file("ok.off", off));
+  CHECK(meshes.size() == 1);
+  if (!meshes.empty()) {
+    CHECK(triangles(meshes[0]) ==
+          std::vector<glm::vec3>({at(0, 0), at(1, 0), at(1, 1), at(0, 0),
+                                  at(1, 1), at(0, 1), at(1, 0), at(2, 0),
+                                  at(1, 1)}));
+  }
+
+  // malformed OFF files give no mesh rather than a broken one
+  for (const char *text : {"OFF\n3 1 0\n0 0 0\n1 0 0\n1 1 0\n3 0 1 3\n",
+                           "OFF\n3 1 0\n0 0 0\n1 0 0\n1 1 0\n3 0 1\n",
+                           "OFF\n3 2 0\n0 0 0\n1 0 0\n1 1 0\n3 0 1 2\n",
+                           "OFF\n-3 1 0\n", "OFF\n# nothing\n"}) {
+    CHECK(common::import_off(write_file("bad.off", text)).empty());
+  }
+  CHECK(common::import_model(write_file("empty.obj", "")).empty());
+  return test::result();
+}
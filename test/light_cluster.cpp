@@ -0,0 +1,64 @@
+#include "common/light_cluster.hpp"
+#include "test.hpp"
+
+#include <random>
+
+using namespace cs7gv3;
+
+int main() {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 5.0f), glm::vec3(0.0f),
+                               glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection =
+      glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+  glm::mat4 to_world = glm::inverse(view);
+
+  common::light_clusters_t clusters;
+  clusters.grid.near = 0.1f;
+  clusters.grid.far = 100.0f;
+
+  for (float radius : {0.2f, 1.0f, 5.0f}) {
+    std::vector<glm::vec4> spheres;
+    for (int i = 0; i < 500; i++) {
+      glm::vec3 p(unit(rng) * 8.0f, unit(rng) * 5.0f, unit(rng) * 8.0f);
+      spheres.push_back(glm::vec4(p, radius));
+    }
+    clusters.bin(spheres, view, projection);
+
+    // points anywhere in the frustum, denser near the camera like the
+    // slices
+    const common::cluster_grid_t &grid = clusters.grid;
+    size_t missing = 0, reached = 0;
+    for (int k = 0; k < 200000; k++) {
+      glm::vec2 ndc(unit(rng), unit(rng));
+      float depth =
+          grid.near * std::pow(grid.far / grid.near, unit(rng) * 0.5f + 0.5f);
+      glm::vec3 p(ndc.x * depth / projection[0][0],
+                  ndc.y * depth / projection[1][1], -depth);
+      glm::vec3 world = to_world * glm::vec4(p, 1.0f);
+
+      const std::vector<uint32_t> &binned =
+          clusters.lights(grid.index(ndc, depth));
+      for (uint32_t i = 0; i < spheres.size(); i++) {
+        if (glm::distance(world, glm::vec3(spheres[i])) > radius) {
+          continue;
+        }
+        reached++;
+        if (std::find(binned.begin(), binned.end(), i) == binned.end()) {
+          missing++;
+        }
+      }
+    }
+
+    CHECK(reached > 0);
+    CHECK(missing == 0);
+    // small lights must not land everywhere, that is what clusters are for
+    if (radius < 1.5f) {
+      CHECK(clusters.references() < spheres.size() * grid.size() / 20);
+    }
+  }
+
+  return test::result();
+}
@@ -0,0 +1,99 @@
+#include "common/mesh_cache.hpp"
+#include "test.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+using namespace cs7gv3;
+
+namespace fs = std::filesystem;
+
+// the same meshes, wherever they are served from
+static bool same(const common::mesh_cache_t &a,
+                 const common::mesh_cache_t &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    auto va = a.vertices(i), vb = b.vertices(i);
+    auto ia = a.indices(i), ib = b.indices(i);
+    if (va.size() != vb.size() || ia.size() != ib.size() ||
+        a.lods(i).size() != b.lods(i).size()) {
+      return false;
+    }
+    for (size_t j = 0; j < va.size(); j++) {
+      if (va[j].position != vb[j].position) {
+        return false;
+      }
+    }
+    if (!std::equal(ia.begin(), ia.end(), ib.begin())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  fs::path dir = fs::temp_directory_path() / "cs7gv3_mesh_cache";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  std::string source = (dir / "grid.obj").string();
+  {
+    std::ofstream obj(source);
+    common::mesh_data_t grid = test::grid_mesh(64);
+    for (const common::vertex_t &v : grid.vertices) {
+      obj << "v " << v.position.x << " " << v.position.y << " 0\n";
+    }
+    for (size_t i = 0; i < grid.indices.size(); i += 3) {
+      obj << "f " << grid.indices[i] + 1 << " " << grid.indices[i + 1] + 1
+          << " " << grid.indices[i + 2] + 1 << "\n";
+    }
+  }
+
+  // a cold load writes the cache and maps it, a warm one maps the same
+  common::mesh_cache_dir = (dir / "cache").string();
+  common::mesh_cache_t cold, warm;
+  CHECK(common::load_mesh_cache(source, cold));
+  CHECK(cold.size() == 1);
+  CHECK(fs::exists(common::mesh_cache_dir));
+  CHECK(common::load_mesh_cache(source, warm));
+  CHECK(same(cold, warm));
+
+  // loads of one model racing on a cold cache all get it, whoever renames
+  // last
+  fs::remove_all(common::mesh_cache_dir);
+  std::vector<common::mesh_cache_t> racing(8);
+  std::vector<uint8_t> loaded(racing.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < racing.size(); i++) {
+    threads.emplace_back([&, i]() {
+      loaded[i] = common::load_mesh_cache(source, racing[i]);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < racing.size(); i++) {
+    CHECK(loaded[i] && same(cold, racing[i]));
+  }
+  for (const auto &entry : fs::directory_iterator(common::mesh_cache_dir)) {
+    CHECK(entry.path().extension() == ".mesh");
+  }
+
+  // a cache that cannot be written still gives the model, from memory
+  common::mesh_cache_dir = (dir / "grid.obj" / "cache").string();
+  common::mesh_cache_t held;
+  CHECK(common::load_mesh_cache(source, held));
+  CHECK(same(cold, held));
+
+  // a missing model is the only failure
+  common::mesh_cache_t missing;
+  CHECK(!common::load_mesh_cache((dir / "missing.obj").string(), missing));
+  CHECK(missing.size() == 0);
+
+  fs::remove_all(dir);
+  return test::result();
+}
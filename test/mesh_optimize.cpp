@@ -0,0 +1,62 @@
+#include "common/mesh_optimize.hpp"
+#include "test.hpp"
+
+#include <array>
+#include <set>
+
+using namespace cs7gv3;
+
+namespace {
+
+// triangles as sorted position triples, independent of vertex and index
+// order
+std::multiset<std::array<float, 9>>
+triangle_set(const common::mesh_data_t &mesh, size_t count) {
+  std::multiset<std::array<float, 9>> set;
+  for (size_t i = 0; i < count; i += 3) {
+    std::array<glm::vec3, 3> t;
+    for (int k = 0; k < 3; k++) {
+      t[k] = mesh.vertices[mesh.indices[i + k]].position;
+    }
+    std::sort(t.begin(), t.end(), [](const glm::vec3 &a, const glm::vec3 &b) {
+      return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    });
+    set.insert({t[0].x, t[0].y, t[0].z, t[1].x, t[1].y, t[1].z, t[2].x,
+                t[2].y, t[2].z});
+  }
+  return set;
+}
+
+} // namespace
+
+int main() {
+  common::mesh_data_t mesh = test::grid_mesh(64);
+  auto before = triangle_set(mesh, mesh.indices.size());
+  size_t n_vertices = mesh.vertices.size();
+
+  common::optimize_stats_t stats = common::optimize_mesh(mesh);
+
+  // same surface, every vertex still used
+  CHECK(triangle_set(mesh, mesh.indices.size()) == before);
+  CHECK(mesh.vertices.size() == n_vertices);
+
+  // a shuffled grid misses nearly every corner, a good order transforms
+  // each vertex about once, two triangles per vertex. no order can miss
+  // less than once per vertex.
+  CHECK(stats.misses_after >= n_vertices);
+  CHECK(stats.acmr_before() > 1.5f);
+  CHECK(stats.acmr_after() < 0.8f);
+
+  // duplicated corners are welded
+  common::mesh_data_t split = test::grid_mesh(8);
+  std::vector<common::vertex_t> corners;
+  for (uint32_t &i : split.indices) {
+    corners.push_back(split.vertices[i]);
+    i = corners.size() - 1;
+  }
+  split.vertices = corners;
+  common::optimize_mesh(split);
+  CHECK(split.vertices.size() == 9 * 9);
+
+  return test::result();
+}
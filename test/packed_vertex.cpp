@@ -0,0 +1,117 @@
+#include "common/packed_vertex.hpp"
+#include "test.hpp"
+
+#include <cstring>
+#include <random>
+
+using namespace cs7gv3;
+
+namespace {
+
+// what the GPU reads back, GL 4.2 rules for the snorm fields
+
+float half_to_float(uint16_t h) {
+  uint32_t sign = (h & 0x8000u) << 16;
+  int exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    float f = std::ldexp((float)mantissa, -24);
+    return sign ? -f : f;
+  }
+  uint32_t biased = exponent == 31 ? 0xff : exponent - 15 + 127;
+  uint32_t x = sign | (biased << 23) | (mantissa << 13);
+  float f;
+  std::memcpy(&f, &x, 4);
+  return f;
+}
+
+float snorm(uint32_t bits, int width) {
+  int32_t v = (int32_t)(bits << (32 - width)) >> (32 - width);
+  return std::max((float)v / (float)((1 << (width - 1)) - 1), -1.0f);
+}
+
+glm::vec4 unpack_1010102(uint32_t p) {
+  return glm::vec4(snorm(p & 0x3ff, 10), snorm((p >> 10) & 0x3ff, 10),
+                   snorm((p >> 20) & 0x3ff, 10), snorm(p >> 30, 2));
+}
+
+glm::vec3 unit(std::mt19937 &rng) {
+  std::normal_distribution<float> n;
+  return glm::normalize(glm::vec3(n(rng), n(rng), n(rng)));
+}
+
+} // namespace
+
+int main() {
+  // exact halves of values a texture coordinate takes
+  CHECK(common::detail::float_to_half(0.0f) == 0x0000);
+  CHECK(common::detail::float_to_half(1.0f) == 0x3c00);
+  CHECK(common::detail::float_to_half(-2.0f) == 0xc000);
+  CHECK(common::detail::float_to_half(0.5f) == 0x3800);
+  CHECK(common::detail::float_to_half(65504.0f) == 0x7bff);
+  CHECK(common::detail::float_to_half(1e6f) == 0x7c00);
+  CHECK(common::detail::float_to_half(std::ldexp(1.0f, -24)) == 0x0001);
+
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> coordinate(-4.0f, 4.0f);
+
+  std::vector<common::vertex_t> vertices(10000);
+  for (common::vertex_t &v : vertices) {
+    v.position = glm::vec3(coordinate(rng), coordinate(rng) * 0.1f,
+                           coordinate(rng) * 30.0f);
+    v.normal = unit(rng);
+    v.tangent = glm::normalize(glm::cross(v.normal, unit(rng)));
+    v.bitangent = glm::cross(v.normal, v.tangent);
+    if (rng() % 2) {
+      v.bitangent = -v.bitangent;
+    }
+    v.texture_coordinate = glm::vec2(coordinate(rng), coordinate(rng));
+  }
+  vertices[0].position = glm::vec3(0.0f); // a flat axis is not divided by
+
+  common::quantization_t q =
+      common::position_quantization({vertices.data(), vertices.size()});
+  std::vector<common::packed_vertex_t> packed =
+      common::pack_vertices({vertices.data(), vertices.size()}, q);
+  CHECK(packed.size() == vertices.size());
+
+  // unorm16 steps of the box, to nearest. 10 bit snorm steps are 1 / 511.
+  // halves keep 11 significant bits.
+  float position_error = 0.0f, normal_error = 0.0f;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const common::vertex_t &v = vertices[i];
+    const common::packed_vertex_t &p = packed[i];
+    for (int k = 0; k < 3; k++) {
+      float decoded = q.offset[k] + p.position[k] / 65535.0f * q.scale[k];
+      float error = std::abs(decoded - v.position[k]);
+      // plus float rounding of the offset and scale in the decode
+      CHECK(error <= q.scale[k] * (0.5f / 65535.0f) +
+                         1e-6f * (std::abs(q.offset[k]) + q.scale[k]));
+      position_error = std::max(position_error, error / q.scale[k]);
+    }
+
+    glm::vec4 n = unpack_1010102(p.normal);
+    glm::vec4 t = unpack_1010102(p.tangent);
+    for (int k = 0; k < 3; k++) {
+      normal_error = std::max(normal_error, std::abs(n[k] - v.normal[k]));
+      CHECK(std::abs(n[k] - v.normal[k]) <= 0.5f / 511.0f + 1e-6f);
+      CHECK(std::abs(t[k] - v.tangent[k]) <= 0.5f / 511.0f + 1e-6f);
+    }
+
+    // the sign is all w carries, B comes back as cross(N, T) * sign(w)
+    glm::vec3 b = glm::cross(glm::vec3(n), glm::vec3(t)) *
+                  (t.w < 0.0f ? -1.0f : 1.0f);
+    CHECK(glm::dot(b, v.bitangent) > 0.99f);
+
+    for (int k = 0; k < 2; k++) {
+      float decoded = half_to_float(p.texture_coordinate[k]);
+      float expected = v.texture_coordinate[k];
+      CHECK(std::abs(decoded - expected) <=
+            std::abs(expected) * std::ldexp(1.0f, -11) + 1e-7f);
+    }
+  }
+  // the figures quoted for the format, in units of the mesh's extent
+  CHECK(position_error < 2e-5f);
+  CHECK(normal_error < 1e-3f);
+  return test::result();
+}
@@ -0,0 +1,79 @@
+#include "common/point_index.hpp"
+#include "test.hpp"
+
+#include <random>
+
+using namespace cs7gv3;
+
+// checks nearest() and within() against a scan of every vertex
+static void compare(const std::vector<common::vertex_t> &vertices,
+                    std::mt19937 &rng, float spread) {
+  common::point_index_t index({vertices.data(), vertices.size()});
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  std::vector<common::point_index_t::hit_t> hits;
+  for (int q = 0; q < 500; q++) {
+    glm::vec3 p(unit(rng) * spread, unit(rng) * spread, unit(rng) * spread);
+    float radius = std::abs(unit(rng)) * spread * 0.2f;
+
+    float best = INFINITY;
+    std::vector<uint32_t> inside;
+    for (uint32_t i = 0; i < vertices.size(); i++) {
+      float d = glm::distance(vertices[i].position, p);
+      best = std::min(best, d);
+      if (d <= radius) {
+        inside.push_back(i);
+      }
+    }
+
+    // ties may pick any of the points, the distance is what must match
+    common::point_index_t::hit_t hit{};
+    CHECK(index.nearest(p, hit));
+    CHECK(hit.index < vertices.size());
+    CHECK(std::abs(hit.distance - best) <= 1e-4f * (1.0f + best));
+    CHECK(std::abs(glm::distance(vertices[hit.index].position, p) -
+                   hit.distance) <= 1e-4f * (1.0f + best));
+    CHECK(!index.nearest(p, hit, best * 0.99f) || best == 0.0f);
+
+    hits.clear();
+    index.within(p, radius, hits);
+    std::vector<uint32_t> found;
+    for (const auto &h : hits) {
+      found.push_back(h.index);
+    }
+    std::sort(found.begin(), found.end());
+    CHECK(found == inside);
+  }
+}
+
+int main() {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  // a cloud, clustered around a few centres so leaves are uneven
+  std::vector<common::vertex_t> cloud;
+  for (int c = 0; c < 8; c++) {
+    glm::vec3 centre(unit(rng) * 8.0f, unit(rng) * 8.0f, unit(rng) * 8.0f);
+    for (int i = 0; i < 1237; i++) {
+      common::vertex_t v{};
+      v.position = centre + glm::vec3(unit(rng), unit(rng), unit(rng));
+      cloud.push_back(v);
+    }
+  }
+  compare(cloud, rng, 10.0f);
+
+  // a grid is full of equal distances and equal split coordinates
+  compare(test::grid_mesh(40).vertices, rng, 40.0f);
+
+  // fewer points than a leaf, and the same point many times
+  std::vector<common::vertex_t> few(cloud.begin(), cloud.begin() + 5);
+  compare(few, rng, 10.0f);
+  std::vector<common::vertex_t> same(100, cloud[0]);
+  compare(same, rng, 10.0f);
+
+  common::point_index_t empty;
+  common::point_index_t::hit_t hit{};
+  CHECK(empty.empty());
+  CHECK(!empty.nearest(glm::vec3(0.0f), hit));
+  return test::result();
+}
@@ -0,0 +1,60 @@
+#include "common/simplify.hpp"
+#include "test.hpp"
+
+#include <cmath>
+#include <set>
+
+using namespace cs7gv3;
+
+int main() {
+  // a bumpy height field, so collapses really move the surface
+  common::mesh_data_t mesh = test::grid_mesh(48);
+  for (common::vertex_t &v : mesh.vertices) {
+    v.position.z = 2.0f * std::sin(v.position.x * 0.4f) *
+                   std::cos(v.position.y * 0.3f);
+  }
+  const std::vector<common::vertex_t> full = mesh.vertices;
+  const size_t n_triangles = mesh.indices.size() / 3;
+
+  common::build_lods(mesh);
+  CHECK(mesh.lods.size() == common::lod_ratios.size() + 1);
+  CHECK(mesh.lods[0].first == 0);
+  CHECK(mesh.lods[0].count == n_triangles * 3);
+  CHECK(mesh.lods[0].error == 0.0f);
+  // simplification only rewrites indices
+  CHECK(mesh.vertices.size() == full.size());
+
+  for (size_t lod = 1; lod < mesh.lods.size(); lod++) {
+    const common::lod_t &level = mesh.lods[lod];
+    CHECK(level.count % 3 == 0);
+    CHECK(level.count / 3 <= n_triangles * common::lod_ratios[lod - 1]);
+    CHECK(level.count < mesh.lods[lod - 1].count);
+    CHECK(level.error >= mesh.lods[lod - 1].error);
+    CHECK(level.first + level.count <= mesh.indices.size());
+
+    // every vertex of the full mesh has a vertex of the level within the
+    // error, which is what lets select_lod() trust it
+    std::set<uint32_t> used(mesh.indices.begin() + level.first,
+                            mesh.indices.begin() + level.first + level.count);
+    float worst = 0.0f;
+    for (const common::vertex_t &v : full) {
+      float nearest = INFINITY;
+      for (uint32_t i : used) {
+        nearest = std::min(nearest,
+                           glm::distance(v.position, full[i].position));
+      }
+      worst = std::max(worst, nearest);
+    }
+    CHECK(worst <= level.error * 1.0001f);
+
+    // borders are locked
+    for (uint32_t i : used) {
+      CHECK(i < full.size());
+    }
+    for (uint32_t y = 0; y <= 48; y++) {
+      CHECK(used.count(y * 49) && used.count(y * 49 + 48));
+    }
+  }
+
+  return test::result();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common/mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// Minimal checks for the CPU side of common/. A failed CHECK prints where
+// it was and the test carries on; main() returns test::result().
+namespace cs7gv3::test {
+
+inline int failures = 0;
+
+inline int result() {
+  if (failures) {
+    std::printf("%d check(s) failed\n", failures);
+  }
+  return failures != 0;
+}
+
+// a flat n x n quad grid in the xy plane, two triangles per quad, in a
+// shuffled order so nothing is cache friendly to begin with
+inline common::mesh_data_t grid_mesh(uint32_t n, uint32_t seed = 1) {
+  common::mesh_data_t mesh;
+  for (uint32_t y = 0; y <= n; y++) {
+    for (uint32_t x = 0; x <= n; x++) {
+      common::vertex_t v{};
+      v.position = glm::vec3((float)x, (float)y, 0.0f);
+      v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+      v.texture_coordinate = glm::vec2((float)x / n, (float)y / n);
+      mesh.vertices.push_back(v);
+    }
+  }
+
+  std::vector<std::array<uint32_t, 3>> triangles;
+  for (uint32_t y = 0; y < n; y++) {
+    for (uint32_t x = 0; x < n; x++) {
+      uint32_t a = y * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+      triangles.push_back({a, b, d});
+      triangles.push_back({a, d, c});
+    }
+  }
+  std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+  for (const auto &t : triangles) {
+    mesh.indices.insert(mesh.indices.end(), t.begin(), t.end());
+  }
+  return mesh;
+}
+
+} // namespace cs7gv3::test
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);     \
+      cs7gv3::test::failures++;                                                \
+    }                                                                          \
+  } while (0)
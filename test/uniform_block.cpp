@@ -0,0 +1,96 @@
+#include "common/uniform_block.hpp"
+#include "test.hpp"
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cs7gv3;
+
+namespace {
+
+// member offsets and block size of a GLSL block under std140, for the few
+// types the blocks use
+struct layout_t {
+  std::vector<size_t> offsets;
+  size_t size = 0;
+};
+
+layout_t std140(const std::string &glsl) {
+  std::istringstream in(glsl.substr(glsl.find('{') + 1));
+  layout_t layout;
+  std::string type, name;
+  while (in >> type && type != "}" && type.rfind("}", 0) != 0) {
+    in >> name;
+    size_t size = 0, align = 0;
+    if (type == "float" || type == "int" || type == "uint") {
+      size = align = 4;
+    } else if (type == "vec2") {
+      size = align = 8;
+    } else if (type == "vec3") {
+      size = 12, align = 16;
+    } else if (type == "vec4") {
+      size = align = 16;
+    } else if (type == "mat4") {
+      size = 64, align = 16;
+    } else {
+      std::printf("unknown type %s\n", type.c_str());
+      test::failures++;
+      return layout;
+    }
+    layout.size = (layout.size + align - 1) / align * align;
+    layout.offsets.push_back(layout.size);
+    layout.size += size;
+  }
+  // a block is padded to the alignment of a vec4
+  layout.size = (layout.size + 15) / 16 * 16;
+  return layout;
+}
+
+void check(const char *name, const layout_t &glsl,
+           const std::vector<size_t> &cpp, size_t cpp_size) {
+  CHECK(glsl.offsets == cpp);
+  CHECK(glsl.size == cpp_size);
+  if (glsl.offsets != cpp || glsl.size != cpp_size) {
+    std::printf("in %s\n", name);
+  }
+}
+
+} // namespace
+
+int main() {
+  // the members the GLSL declares, the _pad fields have no counterpart
+  check("frame_block", std140(CS7GV3_FRAME_BLOCK_GLSL),
+        {offsetof(common::frame_block_t, view),
+         offsetof(common::frame_block_t, projection),
+         offsetof(common::frame_block_t, view_pos),
+         offsetof(common::frame_block_t, time)},
+        sizeof(common::frame_block_t));
+
+  check("light_block", std140(CS7GV3_LIGHT_BLOCK_GLSL),
+        {offsetof(common::light_block_t, position),
+         offsetof(common::light_block_t, ambient_color),
+         offsetof(common::light_block_t, diffuse_color),
+         offsetof(common::light_block_t, specular_color)},
+        sizeof(common::light_block_t));
+
+  check("material_block", std140(CS7GV3_MATERIAL_BLOCK_GLSL),
+        {offsetof(common::material_block_t, ambient_color),
+         offsetof(common::material_block_t, shininess),
+         offsetof(common::material_block_t, diffuse_color),
+         offsetof(common::material_block_t, metallic),
+         offsetof(common::material_block_t, specular_color),
+         offsetof(common::material_block_t, roughness),
+         offsetof(common::material_block_t, albedo),
+         offsetof(common::material_block_t, ao)},
+        sizeof(common::material_block_t));
+
+  // update() compares blocks bytewise, so no padding may be implicit
+  CHECK(sizeof(common::frame_block_t) ==
+        2 * sizeof(glm::mat4) + sizeof(glm::vec3) + sizeof(float));
+  CHECK(sizeof(common::light_block_t) == 4 * (sizeof(glm::vec3) + 4));
+  CHECK(sizeof(common::material_block_t) == 4 * (sizeof(glm::vec3) + 4));
+
+  return test::result();
+}
@@ -1,7 +1,7 @@
 set_languages("c17", "cxx17")
 -- set_warnings("all", "error")
 
-add_includedirs("module/figine/include", "/opt/homebrew/include")
+add_includedirs(".", "module/figine/include", "/opt/homebrew/include")
 
 add_linkdirs("/opt/homebrew/lib")
 
@@ -38,3 +38,14 @@ target("assignment5")
     add_deps("figine")
     add_files("assignment5/**.cpp")
     add_links("figine")
+
+-- one binary per file, `xmake test` builds and runs them
+for _, file in ipairs(os.files("test/*.cpp")) do
+    target("test_" .. path.basename(file))
+        set_kind("binary")
+        set_default(false)
+        add_deps("figine")
+        add_files(file)
+        add_links("figine")
+        add_tests("default")
+end